@@ -0,0 +1,86 @@
+/*
+ * Copyright (C) 2026 Jolla Ltd.
+ *
+ * You may use this file under the terms of BSD license as follows:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *   3. Neither the names of the copyright holders nor the names of its
+ *      contributors may be used to endorse or promote products derived
+ *      from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef DBUSACCESS_CRED_H
+#define DBUSACCESS_CRED_H
+
+#include "dbusaccess_types.h"
+
+G_BEGIN_DECLS
+
+/*
+ * Prepared credentials carry the data derived from DACred which can be
+ * reused by the repeated policy checks (sorted group list and such).
+ * Preparing credentials once per peer/process pays off if the same
+ * credentials are checked against policies more than a few times.
+ *
+ * The groups in the prepared DACred are sorted and have no duplicates.
+ */
+
+struct da_cred_prepared {
+    DACred cred;
+};
+
+/* Since 1.0.21 */
+
+DACredPrepared*
+da_cred_prepared_new(
+    const DACred* cred);
+
+DACredPrepared*
+da_cred_prepared_ref(
+    DACredPrepared* prepared);
+
+void
+da_cred_prepared_unref(
+    DACredPrepared* prepared);
+
+/*
+ * Returns a reference to the process-wide prepared credentials equal to
+ * the given ones. Identical credentials (the same set of groups, in any
+ * order) share the same immutable record and can be compared by pointer.
+ * The intern table doesn't hold references. Since 1.0.21
+ */
+DACredPrepared*
+da_cred_prepared_intern(
+    const DACred* cred);
+
+G_END_DECLS
+
+#endif /* DBUSACCESS_CRED_H */
+
+/*
+ * Local Variables:
+ * mode: C
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
@@ -33,10 +33,15 @@
 #ifndef DBUSACCESS_PEER_H
 #define DBUSACCESS_PEER_H
 
-#include "dbusaccess_types.h"
+#include "dbusaccess_cred.h"
 
 G_BEGIN_DECLS
 
+/*
+ * Since 1.0.21 cred.groups is sorted and has no duplicates (it's shared
+ * with the prepared credentials, see da_peer_prepared_cred) and may
+ * therefore be shorter than the list reported by the kernel.
+ */
 struct da_peer {
     DA_BUS bus;
     const char* name;
@@ -57,6 +62,18 @@ da_peer_get(
     DA_BUS bus,
     const char* name);
 
+/*
+ * Same as da_peer_get but only fetches the optional parts of DACred
+ * requested by DBUSACCESS_CRED_* flags in fields. A cached peer which
+ * lacks some of the requested fields gets refreshed in place, pointers
+ * returned earlier remain valid. Since 1.0.21
+ */
+DAPeer*
+da_peer_get_full(
+    DA_BUS bus,
+    const char* name,
+    guint32 fields);
+
 DAPeer*
 da_peer_ref(
     DAPeer* peer);
@@ -65,6 +82,16 @@ void
 da_peer_unref(
     DAPeer* peer);
 
+/*
+ * Prepared credentials are interned (see da_cred_prepared_intern) and
+ * stay attached to the peer object, i.e. the returned pointer remains
+ * valid for as long as the DAPeer is alive. Peers with identical
+ * credentials return the same pointer. Since 1.0.21
+ */
+const DACredPrepared*
+da_peer_prepared_cred(
+    DAPeer* peer);
+
 void
 da_peer_flush(
     DA_BUS bus,
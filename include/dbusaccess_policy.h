@@ -65,6 +65,58 @@ typedef struct da_action {
     guint args;         /* Number of arguments (currently only 0 or 1) */
 } DA_ACTION;
 
+/*
+ * With DA_POLICY_FLAG_LAZY_NAMES user and group names are resolved on
+ * the first check which actually needs them rather than at compile time.
+ * Names which can't be resolved yet don't match anything (and are looked
+ * up again later), which is useful for the services starting before the
+ * name service is available. da_policy_equal compares such names as
+ * strings and never resolves them. Since 1.0.21
+ */
+typedef enum da_policy_flags {
+    DA_POLICY_FLAGS_NONE = 0x00,
+    DA_POLICY_FLAG_LAZY_NAMES = 0x01
+} DA_POLICY_FLAGS;
+
+/*
+ * Action table is built once from DA_ACTION array and then can be
+ * used for compiling any number of policies. Unlike the raw arrays,
+ * it's validated upfront: ids must be non-zero and unique, and so must
+ * be the names, otherwise da_action_table_new returns NULL. The table
+ * makes its own copy of the actions. Since 1.0.21
+ */
+
+DAActionTable*
+da_action_table_new(
+    const DA_ACTION* actions); /* Since 1.0.21 */
+
+DAActionTable*
+da_action_table_ref(
+    DAActionTable* table); /* Since 1.0.21 */
+
+void
+da_action_table_unref(
+    DAActionTable* table); /* Since 1.0.21 */
+
+const DA_ACTION*
+da_action_table_find(
+    const DAActionTable* table,
+    const char* name); /* Since 1.0.21 */
+
+/*
+ * Enables on-disk cache of compiled policies for da_policy_new(),
+ * da_policy_new_full(), da_policy_new_with_flags() and
+ * da_policy_new_with_table(). The cache is disabled by default,
+ * NULL disables it again. The directory is created on demand.
+ * Cached files are ignored unless both the file and the directory
+ * belong to the effective user and aren't writable by anyone else.
+ * Policies referring to unknown users or groups aren't cached, unless
+ * the names are resolved lazily. Since 1.0.21
+ */
+void
+da_policy_set_cache_dir(
+    const char* dir); /* Since 1.0.21 */
+
 DAPolicy*
 da_policy_new(
     const char* spec);
@@ -74,6 +126,40 @@ da_policy_new_full(
     const char* spec,
     const DA_ACTION* actions);
 
+DAPolicy*
+da_policy_new_with_flags(
+    const char* spec,
+    const DA_ACTION* actions,
+    DA_POLICY_FLAGS flags); /* Since 1.0.21 */
+
+DAPolicy*
+da_policy_new_with_table(
+    const char* spec,
+    DAActionTable* table,
+    DA_POLICY_FLAGS flags); /* Since 1.0.21 */
+
+DAPolicy*
+da_policy_new_from_buffer(
+    const void* data,
+    gsize len,
+    const DA_ACTION* actions); /* Since 1.0.21 */
+
+DAPolicy*
+da_policy_new_from_file(
+    const char* path,
+    const DA_ACTION* actions); /* Since 1.0.21 */
+
+/*
+ * Returns a new reference to the existing policy if there's one compiled
+ * from the same spec and the same actions, otherwise compiles a new one.
+ * The process-wide table of shared policies doesn't hold references to
+ * them. Since 1.0.21
+ */
+DAPolicy*
+da_policy_new_shared(
+    const char* spec,
+    const DA_ACTION* actions); /* Since 1.0.21 */
+
 DAPolicy*
 da_policy_ref(
     DAPolicy* policy);
@@ -87,6 +173,15 @@ da_policy_equal(
     const DAPolicy* policy1,
     const DAPolicy* policy2);
 
+/*
+ * Returns the optional DACred fields (DBUSACCESS_CRED_* flags) that
+ * the policy looks at. Credentials passed to da_policy_check may omit
+ * the other ones. Since 1.0.21
+ */
+guint32
+da_policy_cred_fields(
+    const DAPolicy* policy);
+
 DA_ACCESS
 da_policy_check(
     const DAPolicy* policy,
@@ -95,6 +190,72 @@ da_policy_check(
     const char* arg,
     DA_ACCESS def);
 
+/*
+ * Same as da_policy_check but takes the prepared credentials, which
+ * makes repeated checks of the same credentials cheaper. Since 1.0.21
+ */
+DA_ACCESS
+da_policy_check_prepared(
+    const DAPolicy* policy,
+    const DACredPrepared* prepared,
+    guint action,
+    const char* arg,
+    DA_ACCESS def);
+
+/*
+ * Policy compiler keeps the scanner, the scratch memory and the action
+ * index between compilations, which makes it cheaper to compile many
+ * policies sharing the same set of actions. The actions are copied into
+ * the compiler (or its action table), the caller's array doesn't need to
+ * outlive the call. The compiler is not thread safe, each thread needs
+ * its own instance. Since 1.0.21
+ */
+
+DAPolicyCompiler*
+da_policy_compiler_new(
+    const DA_ACTION* actions,
+    DA_POLICY_FLAGS flags); /* Since 1.0.21 */
+
+DAPolicyCompiler*
+da_policy_compiler_new_with_table(
+    DAActionTable* table,
+    DA_POLICY_FLAGS flags); /* Since 1.0.21 */
+
+DAPolicyCompiler*
+da_policy_compiler_ref(
+    DAPolicyCompiler* compiler); /* Since 1.0.21 */
+
+void
+da_policy_compiler_unref(
+    DAPolicyCompiler* compiler); /* Since 1.0.21 */
+
+DAPolicy*
+da_policy_compiler_compile(
+    DAPolicyCompiler* compiler,
+    const char* spec); /* Since 1.0.21 */
+
+DAPolicy*
+da_policy_compiler_compile_buffer(
+    DAPolicyCompiler* compiler,
+    const void* data,
+    gsize len); /* Since 1.0.21 */
+
+/*
+ * Compiles count policies on a thread pool (max_threads includes the
+ * calling thread, zero means the number of online CPUs). The results
+ * are stored in the policies array, with NULL for the specs that failed
+ * to compile. Returns the number of successfully compiled policies.
+ * The table may be NULL if no custom actions are used. Since 1.0.21
+ */
+guint
+da_policy_compile_all(
+    const char* const* specs,
+    guint count,
+    DAActionTable* table,
+    DA_POLICY_FLAGS flags,
+    guint max_threads,
+    DAPolicy** policies); /* Since 1.0.21 */
+
 G_END_DECLS
 
 #endif /* DBUSACCESS_POLICY_H */
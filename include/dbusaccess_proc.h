@@ -33,21 +33,88 @@
 #ifndef DBUSACCESS_PROC_H
 #define DBUSACCESS_PROC_H
 
-#include "dbusaccess_types.h"
+#include "dbusaccess_cred.h"
 
 G_BEGIN_DECLS
 
+/*
+ * Since 1.0.21 cred.groups is sorted and has no duplicates (it's shared
+ * with the prepared credentials, see da_proc_prepared_cred) and may
+ * therefore be shorter than the list reported by the kernel.
+ */
 struct da_proc {
     pid_t pid;
     DACred cred;
 };
 
+typedef
+void
+(*DAProcFunc)(
+    DAProc* proc,
+    void* user_data); /* Since 1.0.21 */
+
 /* Since 1.0.13 */
 
 DAProc*
 da_proc_new(
     pid_t pid);
 
+/*
+ * Fields is a combination of DBUSACCESS_CRED_* flags, telling which
+ * optional parts of DACred the caller needs. Skipping the ones which
+ * aren't needed saves time and memory. The flags in DACred tell which
+ * fields are actually valid. Since 1.0.21
+ */
+DAProc*
+da_proc_new_full(
+    pid_t pid,
+    guint32 fields);
+
+/*
+ * Reads the credentials of count processes on a thread pool (max_threads
+ * includes the calling thread, zero means the number of online CPUs).
+ * The results are stored in the procs array, with NULL for the processes
+ * that couldn't be read. Returns the number of successfully created
+ * objects. Since 1.0.21
+ */
+guint
+da_proc_new_all(
+    const pid_t* pids,
+    guint count,
+    guint32 fields,
+    guint max_threads,
+    DAProc** procs);
+
+/*
+ * Same as da_proc_new_all for all processes listed in /proc. Returns
+ * NULL if there are none, otherwise the result should be released with
+ * da_proc_list_free. Since 1.0.21
+ */
+DAProc**
+da_proc_snapshot(
+    guint32 fields,
+    guint max_threads,
+    guint* count);
+
+void
+da_proc_list_free(
+    DAProc** procs,
+    guint count); /* Since 1.0.21 */
+
+/*
+ * Takes the credentials of the peer connected to the Unix socket from
+ * the kernel (SO_PEERCRED and SO_PEERGROUPS), i.e. as they were when
+ * the connection was established. /proc is only read if capabilities
+ * are requested, or if the kernel doesn't support SO_PEERGROUPS. Those
+ * fields are left out if the process found in /proc doesn't have the
+ * peer's uid and gid (or has exited while it was being read), because
+ * the pid may have been reused. Since 1.0.21
+ */
+DAProc*
+da_proc_new_from_socket(
+    int fd,
+    guint32 fields);
+
 DAProc*
 da_proc_ref(
     DAProc* proc);
@@ -56,6 +123,121 @@ void
 da_proc_unref(
     DAProc* proc);
 
+/*
+ * Prepared credentials are interned (see da_cred_prepared_intern) and
+ * stay attached to the process object, i.e. the returned pointer remains
+ * valid for as long as the DAProc is alive. Processes with identical
+ * credentials return the same pointer. Since 1.0.21
+ */
+const DACredPrepared*
+da_proc_prepared_cred(
+    DAProc* proc);
+
+/*
+ * Same as da_proc_new_full but also keeps a pidfd for the process, which
+ * is opened before reading the credentials. If the process exits in the
+ * meantime, NULL is returned, i.e. the credentials can't belong to
+ * another process which has reused the pid. On kernels without pidfd
+ * support (older than 5.3) the object is created without one.
+ * Since 1.0.21
+ */
+DAProc*
+da_proc_new_pidfd(
+    pid_t pid,
+    guint32 fields);
+
+/* Returns -1 if the object has no pidfd. Since 1.0.21 */
+int
+da_proc_pidfd(
+    DAProc* proc);
+
+/*
+ * Without pidfd, this only checks whether the pid exists, which may
+ * belong to a different process by now. Since 1.0.21
+ */
+gboolean
+da_proc_alive(
+    DAProc* proc);
+
+/*
+ * The handler is invoked once, when the process exits. The watch is
+ * attached to the thread-default main context and the handler has to be
+ * removed from the same thread. Returns zero if the object has no
+ * pidfd. Since 1.0.21
+ */
+guint
+da_proc_add_exit_handler(
+    DAProc* proc,
+    DAProcFunc fn,
+    void* user_data);
+
+void
+da_proc_remove_exit_handler(
+    DAProc* proc,
+    guint id); /* Since 1.0.21 */
+
+/*
+ * Thread-safe cache of DAProc objects keyed by pid. Entries are checked
+ * against pid reuse (with pidfd or the process start time), expire after
+ * ttl_ms milliseconds and the least recently used ones get evicted when
+ * the cache is full. da_proc_cache_get returns a new reference.
+ *
+ * Each entry keeps a pidfd open, i.e. a cache may hold up to max_entries
+ * file descriptors. The shared instance holds up to 256 entries, which
+ * expire after 5 seconds. Since 1.0.21
+ */
+
+typedef struct da_proc_cache_stats {
+    guint64 hits;
+    guint64 misses;
+    guint64 evictions;      /* Dropped to stay within the size limit */
+    guint64 expirations;    /* Dropped because of TTL or process exit */
+    guint size;
+} DAProcCacheStats;
+
+DAProcCache*
+da_proc_cache_new(
+    guint max_entries,
+    guint ttl_ms,
+    guint32 fields);
+
+/* Process-wide instance, returns a new reference */
+DAProcCache*
+da_proc_cache_shared(
+    void);
+
+DAProcCache*
+da_proc_cache_ref(
+    DAProcCache* cache);
+
+void
+da_proc_cache_unref(
+    DAProcCache* cache);
+
+void
+da_proc_cache_set_ttl(
+    DAProcCache* cache,
+    guint ttl_ms);
+
+DAProc*
+da_proc_cache_get(
+    DAProcCache* cache,
+    pid_t pid);
+
+void
+da_proc_cache_remove(
+    DAProcCache* cache,
+    pid_t pid);
+
+void
+da_proc_cache_clear(
+    DAProcCache* cache);
+
+void
+da_proc_cache_get_stats(
+    DAProcCache* cache,
+    DAProcCacheStats* stats);
+
 G_END_DECLS
 
 #endif /* DBUSACCESS_PROC_H */
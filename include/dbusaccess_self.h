@@ -39,8 +39,10 @@ G_BEGIN_DECLS
 
 /*
  * da_self_new_shared returns the reference to the shared instance,
- * da_self_new always allocates the new one. Shared instance should
- * only be used if you can assume that process credentials never change.
+ * da_self_new always allocates the new one. The shared instance is
+ * checked against the current credentials (which takes a few cheap
+ * syscalls) and gets replaced if they have changed. No main loop is
+ * required. Since 1.0.21 the shared instance no longer expires by timer.
  *
  * You can use da_self_flush to clear the shared instance and force the
  * next da_self_new_shared call to create a new one.
@@ -66,6 +68,14 @@ void
 da_self_flush(
     void);
 
+/*
+ * Incremented every time the shared instance gets replaced or flushed.
+ * Since 1.0.21
+ */
+guint
+da_self_shared_generation(
+    void);
+
 G_END_DECLS
 
 #endif /* DBUSACCESS_SELF_H */
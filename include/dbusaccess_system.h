@@ -35,6 +35,12 @@
 
 #include "dbusaccess_types.h"
 
+/*
+ * These return -1 if the name is unknown. Successful lookups are cached
+ * until /etc/passwd or /etc/group gets modified (the files are checked
+ * at most once per second). Both functions are thread-safe.
+ */
+
 int
 da_system_uid(
     const char* user);
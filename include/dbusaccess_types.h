@@ -60,6 +60,7 @@ typedef struct da_cred {
 
 #define DBUSACCESS_CRED_CAPS    (0x0001)
 #define DBUSACCESS_CRED_GROUPS  (0x0002)
+#define DBUSACCESS_CRED_ALL     (0x0003) /* Since 1.0.21 */
 
 } DACred;
 
@@ -67,6 +68,10 @@ typedef struct da_proc DAProc; /* Since 1.0.13 */
 typedef struct da_proc DASelf;
 typedef struct da_peer DAPeer;
 typedef struct da_policy /* opaque */ DAPolicy;
+typedef struct da_cred_prepared DACredPrepared; /* Since 1.0.21 */
+typedef struct da_policy_compiler DAPolicyCompiler; /* Since 1.0.21 */
+typedef struct da_action_table DAActionTable; /* Since 1.0.21 */
+typedef struct da_proc_cache DAProcCache; /* Since 1.0.21 */
 
 extern GLogModule DBUSACCESS_LOG_MODULE;
 
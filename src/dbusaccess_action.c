@@ -0,0 +1,172 @@
+/*
+ * Copyright (C) 2026 Jolla Ltd.
+ *
+ * You may use this file under the terms of BSD license as follows:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *   3. Neither the names of the copyright holders nor the names of its
+ *      contributors may be used to endorse or promote products derived
+ *      from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "dbusaccess_action_p.h"
+#include "dbusaccess_log.h"
+
+/*
+ * Action table is immutable once created and therefore can be shared
+ * between threads and between any number of compilers and policies.
+ */
+
+struct da_action_table {
+    gint ref_count;
+    DA_ACTION* actions;     /* Private copy, terminated by NULL name */
+    GHashTable* names;      /* name => const DA_ACTION* */
+};
+
+static
+DAActionTable*
+da_action_table_create(
+    const DA_ACTION* actions,
+    gboolean strict)
+{
+    DAActionTable* table = g_slice_new0(DAActionTable);
+    GHashTable* ids = strict ? g_hash_table_new(g_direct_hash,
+        g_direct_equal) : NULL;
+    gsize i, n = 0, k = 0;
+
+    table->ref_count = 1;
+    table->names = g_hash_table_new(g_str_hash, g_str_equal);
+    if (actions) {
+        while (actions[n].name) n++;
+    }
+    table->actions = g_new0(DA_ACTION, n + 1);
+    for (i = 0; i < n; i++) {
+        const DA_ACTION* src = actions + i;
+        DA_ACTION* action;
+
+        if (g_hash_table_lookup(table->names, src->name)) {
+            if (strict) {
+                GWARN("Duplicate action name \"%s\"", src->name);
+                break;
+            }
+            /* Not indexed, the first one wins like with the linear search */
+            continue;
+        } else if (strict) {
+            if (!src->id) {
+                GWARN("Action \"%s\" has zero id", src->name);
+                break;
+            } else if (g_hash_table_lookup(ids, GUINT_TO_POINTER(src->id))) {
+                GWARN("Duplicate action id %u (\"%s\")", src->id, src->name);
+                break;
+            }
+            g_hash_table_insert(ids, GUINT_TO_POINTER(src->id),
+                GUINT_TO_POINTER(TRUE));
+        }
+        action = table->actions + (k++);
+        action->name = g_strdup(src->name);
+        action->id = src->id;
+        action->args = src->args;
+        g_hash_table_insert(table->names, (gpointer)action->name, action);
+    }
+    if (ids) {
+        g_hash_table_destroy(ids);
+    }
+    if (i < n) {
+        da_action_table_unref(table);
+        return NULL;
+    }
+    return table;
+}
+
+DAActionTable*
+da_action_table_new(
+    const DA_ACTION* actions)
+{
+    return da_action_table_create(actions, TRUE);
+}
+
+DAActionTable*
+da_action_table_new_lenient(
+    const DA_ACTION* actions)
+{
+    return da_action_table_create(actions, FALSE);
+}
+
+static
+void
+da_action_table_finalize(
+    DAActionTable* table)
+{
+    DA_ACTION* action;
+
+    for (action = table->actions; action->name; action++) {
+        g_free((char*)action->name);
+    }
+    g_hash_table_destroy(table->names);
+    g_free(table->actions);
+}
+
+DAActionTable*
+da_action_table_ref(
+    DAActionTable* table)
+{
+    if (table) {
+        g_atomic_int_inc(&table->ref_count);
+    }
+    return table;
+}
+
+void
+da_action_table_unref(
+    DAActionTable* table)
+{
+    if (table) {
+        if (g_atomic_int_dec_and_test(&table->ref_count)) {
+            da_action_table_finalize(table);
+            g_slice_free(DAActionTable, table);
+        }
+    }
+}
+
+const DA_ACTION*
+da_action_table_actions(
+    const DAActionTable* table)
+{
+    return table ? table->actions : NULL;
+}
+
+const DA_ACTION*
+da_action_table_find(
+    const DAActionTable* table,
+    const char* name)
+{
+    return (table && name) ? g_hash_table_lookup(table->names, name) : NULL;
+}
+
+/*
+ * Local Variables:
+ * mode: C
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
@@ -0,0 +1,501 @@
+/*
+ * Copyright (C) 2026 Jolla Ltd.
+ *
+ * You may use this file under the terms of BSD license as follows:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *   3. Neither the names of the copyright holders nor the names of its
+ *      contributors may be used to endorse or promote products derived
+ *      from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "dbusaccess_cache.h"
+#include "dbusaccess_parser_p.h"
+#include "dbusaccess_log.h"
+
+#include <glib/gstdio.h>
+
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+
+/*
+ * The file format is private to this module and only meant to be read
+ * by the same build of the library on the same machine. It starts with
+ * the magic and the format version, followed by the number of entries.
+ * Each entry is the access byte followed by the expression tree in
+ * prefix order. Numbers are in the native byte order, strings are
+ * length-prefixed and DA_CACHE_NO_STRING stands for NULL.
+ *
+ * Cached files replace the policy text, so they are only trusted if
+ * they (and the directory they are in) belong to the effective user and
+ * can't be modified by anyone else.
+ */
+
+#define DA_CACHE_MAGIC "DAPC"
+#define DA_CACHE_FORMAT (1)
+#define DA_CACHE_NO_EXPR (0xff)
+#define DA_CACHE_NO_STRING G_MAXUINT32
+#define DA_CACHE_MAX_DEPTH (1000)
+
+G_LOCK_DEFINE_STATIC(da_cache);
+static char* da_cache_dir = NULL;
+
+typedef struct da_cache_reader {
+    DAParser* parser;
+    const guint8* ptr;
+    const guint8* end;
+} DACacheReader;
+
+void
+da_cache_set_dir(
+    const char* dir)
+{
+    char* copy = (dir && dir[0]) ? g_strdup(dir) : NULL;
+    char* old;
+
+    G_LOCK(da_cache);
+    old = da_cache_dir;
+    da_cache_dir = copy;
+    G_UNLOCK(da_cache);
+    g_free(old);
+}
+
+static
+void
+da_cache_checksum_string(
+    GChecksum* sum,
+    const char* str)
+{
+    /* Including the terminating NUL */
+    g_checksum_update(sum, (const guchar*)str, strlen(str) + 1);
+}
+
+static
+void
+da_cache_checksum_file(
+    GChecksum* sum,
+    const char* path)
+{
+    struct stat st;
+    guint64 data[5];
+
+    memset(data, 0, sizeof(data));
+    if (!stat(path, &st)) {
+        data[0] = st.st_dev;
+        data[1] = st.st_ino;
+        data[2] = st.st_size;
+        data[3] = st.st_mtime;
+        data[4] = st.st_mtim.tv_nsec;
+    }
+    da_cache_checksum_string(sum, path);
+    g_checksum_update(sum, (const guchar*)data, sizeof(data));
+}
+
+char*
+da_cache_path(
+    const void* spec,
+    gsize len,
+    const DA_ACTION* actions,
+    DA_POLICY_FLAGS flags)
+{
+    char* dir;
+
+    G_LOCK(da_cache);
+    dir = g_strdup(da_cache_dir);
+    G_UNLOCK(da_cache);
+
+    if (dir) {
+        GChecksum* sum = g_checksum_new(G_CHECKSUM_SHA256);
+        guint32 data[3];
+        char* name;
+        char* path;
+
+        data[0] = DA_CACHE_FORMAT;
+        data[1] = flags;
+        data[2] = len;
+        g_checksum_update(sum, (const guchar*)data, sizeof(data));
+        g_checksum_update(sum, spec, len);
+        if (actions) {
+            const DA_ACTION* action;
+
+            for (action = actions; action->name; action++) {
+                da_cache_checksum_string(sum, action->name);
+                data[0] = action->id;
+                data[1] = action->args;
+                g_checksum_update(sum, (const guchar*)data, 2 * sizeof(data[0]));
+            }
+        }
+        da_cache_checksum_file(sum, "/etc/passwd");
+        da_cache_checksum_file(sum, "/etc/group");
+        name = g_strconcat(g_checksum_get_string(sum), ".policy", NULL);
+        path = g_build_filename(dir, name, NULL);
+        g_checksum_free(sum);
+        g_free(name);
+        g_free(dir);
+        return path;
+    }
+    return NULL;
+}
+
+static
+void
+da_cache_write_u32(
+    GByteArray* out,
+    guint32 value)
+{
+    g_byte_array_append(out, (const guint8*)&value, sizeof(value));
+}
+
+static
+void
+da_cache_write_string(
+    GByteArray* out,
+    const char* str)
+{
+    if (str) {
+        const guint32 len = strlen(str);
+        da_cache_write_u32(out, len);
+        g_byte_array_append(out, (const guint8*)str, len);
+    } else {
+        da_cache_write_u32(out, DA_CACHE_NO_STRING);
+    }
+}
+
+static
+void
+da_cache_write_expr(
+    GByteArray* out,
+    const DAParserExpr* expr)
+{
+    guint8 type;
+
+    if (!expr) {
+        type = DA_CACHE_NO_EXPR;
+        g_byte_array_append(out, &type, 1);
+        return;
+    }
+    type = expr->type;
+    g_byte_array_append(out, &type, 1);
+    switch (expr->type) {
+    case DA_PARSER_EXPR_IDENTITY:
+        da_cache_write_u32(out, expr->data.identity.uid);
+        da_cache_write_u32(out, expr->data.identity.gid);
+        da_cache_write_string(out, expr->data.identity.user);
+        da_cache_write_string(out, expr->data.identity.group);
+        break;
+    case DA_PARSER_EXPR_CUSTOM:
+        da_cache_write_u32(out, expr->data.custom.action);
+        da_cache_write_string(out, expr->data.custom.param);
+        break;
+    case DA_PARSER_EXPR_NOT:
+    case DA_PARSER_EXPR_AND:
+    case DA_PARSER_EXPR_OR:
+        da_cache_write_expr(out, expr->data.expr[0]);
+        da_cache_write_expr(out, expr->data.expr[1]);
+        break;
+    }
+}
+
+static
+gboolean
+da_cache_write_file(
+    const char* path,
+    const guint8* data,
+    gsize size)
+{
+    /*
+     * The temporary file is private from the start, otherwise someone
+     * could open it for writing before it gets the right permissions.
+     */
+    char* tmp = g_strconcat(path, ".XXXXXX", NULL);
+    const int fd = g_mkstemp_full(tmp, O_RDWR | O_CLOEXEC, 0600);
+    gboolean ok = FALSE;
+
+    if (fd >= 0) {
+        while (size > 0) {
+            const ssize_t written = write(fd, data, size);
+
+            if (written > 0) {
+                data += written;
+                size -= written;
+            } else if (!written || errno != EINTR) {
+                break;
+            }
+        }
+        if (!size && !fsync(fd)) {
+            ok = TRUE;
+        }
+        if (close(fd)) {
+            ok = FALSE;
+        }
+        if (ok && g_rename(tmp, path)) {
+            ok = FALSE;
+        }
+        if (!ok) {
+            GWARN("Failed to write %s: %s", path, g_strerror(errno));
+            g_unlink(tmp);
+        }
+    } else {
+        GWARN("Failed to create %s: %s", tmp, g_strerror(errno));
+    }
+    g_free(tmp);
+    return ok;
+}
+
+void
+da_cache_store(
+    const char* path,
+    DAParser* parser)
+{
+    GSList* l = da_parser_get_result(parser);
+    GByteArray* out = g_byte_array_new();
+    char* dir = g_path_get_dirname(path);
+
+    g_byte_array_append(out, (const guint8*)DA_CACHE_MAGIC, 4);
+    da_cache_write_u32(out, DA_CACHE_FORMAT);
+    da_cache_write_u32(out, g_slist_length(l));
+    for (; l; l = l->next) {
+        const DAParserEntry* entry = l->data;
+        const guint8 access = entry->access;
+
+        g_byte_array_append(out, &access, 1);
+        da_cache_write_expr(out, entry->expr);
+    }
+
+    g_mkdir_with_parents(dir, 0700);
+    if (da_cache_write_file(path, out->data, out->len)) {
+        GDEBUG("Stored %s", path);
+    }
+    g_byte_array_free(out, TRUE);
+    g_free(dir);
+}
+
+static
+gboolean
+da_cache_read_u8(
+    DACacheReader* in,
+    guint8* value)
+{
+    if (in->ptr < in->end) {
+        *value = *in->ptr++;
+        return TRUE;
+    }
+    return FALSE;
+}
+
+static
+gboolean
+da_cache_read_u32(
+    DACacheReader* in,
+    guint32* value)
+{
+    if ((gsize)(in->end - in->ptr) >= sizeof(*value)) {
+        memcpy(value, in->ptr, sizeof(*value));
+        in->ptr += sizeof(*value);
+        return TRUE;
+    }
+    return FALSE;
+}
+
+static
+gboolean
+da_cache_read_string(
+    DACacheReader* in,
+    const char** str)
+{
+    guint32 len;
+
+    if (da_cache_read_u32(in, &len)) {
+        if (len == DA_CACHE_NO_STRING) {
+            *str = NULL;
+            return TRUE;
+        } else if ((gsize)(in->end - in->ptr) >= len) {
+            *str = da_parser_new_string(in->parser, (const char*)in->ptr, len);
+            in->ptr += len;
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+static
+gboolean
+da_cache_read_expr(
+    DACacheReader* in,
+    DAParserExpr** result,
+    guint depth)
+{
+    DAParserExpr* expr;
+    guint8 type;
+    guint32 u1, u2;
+
+    if (depth > DA_CACHE_MAX_DEPTH || !da_cache_read_u8(in, &type)) {
+        return FALSE;
+    } else if (type == DA_CACHE_NO_EXPR) {
+        *result = NULL;
+        return TRUE;
+    }
+
+    expr = da_parser_alloc(in->parser, sizeof(DAParserExpr));
+    expr->type = type;
+    *result = expr;
+    switch ((DA_PARSER_EXPR)type) {
+    case DA_PARSER_EXPR_IDENTITY:
+        if (da_cache_read_u32(in, &u1) && da_cache_read_u32(in, &u2)) {
+            expr->data.identity.uid = (int)u1;
+            expr->data.identity.gid = (int)u2;
+            return da_cache_read_string(in, &expr->data.identity.user) &&
+                da_cache_read_string(in, &expr->data.identity.group) &&
+                (expr->data.identity.uid != DA_UNRESOLVED ||
+                 expr->data.identity.user) &&
+                (expr->data.identity.gid != DA_UNRESOLVED ||
+                 expr->data.identity.group);
+        }
+        break;
+    case DA_PARSER_EXPR_CUSTOM:
+        if (da_cache_read_u32(in, &u1)) {
+            expr->data.custom.action = u1;
+            return da_cache_read_string(in, &expr->data.custom.param);
+        }
+        break;
+    case DA_PARSER_EXPR_NOT:
+        return da_cache_read_expr(in, expr->data.expr, depth + 1) &&
+            da_cache_read_expr(in, expr->data.expr + 1, depth + 1) &&
+            expr->data.expr[0];
+    case DA_PARSER_EXPR_AND:
+    case DA_PARSER_EXPR_OR:
+        return da_cache_read_expr(in, expr->data.expr, depth + 1) &&
+            da_cache_read_expr(in, expr->data.expr + 1, depth + 1) &&
+            expr->data.expr[0] && expr->data.expr[1];
+    }
+    return FALSE;
+}
+
+static
+gboolean
+da_cache_read(
+    DACacheReader* in)
+{
+    guint32 format, count;
+
+    if ((gsize)(in->end - in->ptr) >= 4 &&
+        !memcmp(in->ptr, DA_CACHE_MAGIC, 4)) {
+        in->ptr += 4;
+        if (da_cache_read_u32(in, &format) && format == DA_CACHE_FORMAT &&
+            da_cache_read_u32(in, &count)) {
+            GSList* entries = NULL;
+            guint32 i;
+
+            for (i = 0; i < count; i++) {
+                DAParserExpr* expr;
+                guint8 access;
+
+                if (!da_cache_read_u8(in, &access) ||
+                    (access != DA_ACCESS_DENY && access != DA_ACCESS_ALLOW) ||
+                    !da_cache_read_expr(in, &expr, 0)) {
+                    return FALSE;
+                }
+                /* Prepended, da_parser_add_entries restores the order */
+                entries = da_parser_new_link(in->parser,
+                    da_parser_new_entry(in->parser, expr, access), entries);
+            }
+            if (in->ptr == in->end) {
+                da_parser_add_entries(in->parser, entries);
+                return TRUE;
+            }
+        }
+    }
+    return FALSE;
+}
+
+static
+gboolean
+da_cache_trusted(
+    const struct stat* st)
+{
+    return st->st_uid == geteuid() && !(st->st_mode & (S_IWGRP | S_IWOTH));
+}
+
+static
+gboolean
+da_cache_trusted_file(
+    const char* path,
+    int fd)
+{
+    struct stat st;
+    char* dir = g_path_get_dirname(path);
+    gboolean ok = FALSE;
+
+    if (!fstat(fd, &st) && S_ISREG(st.st_mode) && da_cache_trusted(&st)) {
+        ok = !stat(dir, &st) && S_ISDIR(st.st_mode) && da_cache_trusted(&st);
+    }
+    if (!ok) {
+        GWARN("Not trusting %s", path);
+    }
+    g_free(dir);
+    return ok;
+}
+
+DAParser*
+da_cache_load(
+    const char* path,
+    DA_POLICY_FLAGS flags)
+{
+    /* Don't follow symlinks, they could point to another cached policy */
+    const int fd = open(path, O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+    DAParser* result = NULL;
+
+    if (fd >= 0) {
+        GMappedFile* map = da_cache_trusted_file(path, fd) ?
+            g_mapped_file_new_from_fd(fd, FALSE, NULL) : NULL;
+
+        if (map) {
+            DAParser* parser = da_parser_new(NULL, NULL, flags);
+            DACacheReader in;
+
+            in.parser = parser;
+            in.ptr = (const guint8*)g_mapped_file_get_contents(map);
+            in.end = in.ptr + g_mapped_file_get_length(map);
+            if (in.ptr && da_cache_read(&in)) {
+                GDEBUG("Loaded %s", path);
+                result = parser;
+            } else {
+                GWARN("Ignoring broken %s", path);
+                da_parser_delete(parser);
+            }
+            g_mapped_file_unref(map);
+        }
+        close(fd);
+    }
+    return result;
+}
+
+/*
+ * Local Variables:
+ * mode: C
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
@@ -0,0 +1,77 @@
+/*
+ * Copyright (C) 2026 Jolla Ltd.
+ *
+ * You may use this file under the terms of BSD license as follows:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *   3. Neither the names of the copyright holders nor the names of its
+ *      contributors may be used to endorse or promote products derived
+ *      from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef DBUSACCESS_CACHE_H
+#define DBUSACCESS_CACHE_H
+
+#include "dbusaccess_parser.h"
+
+/*
+ * On-disk cache of the parser output. Cache file name is derived from
+ * the spec, the actions, the flags and the state of the user and group
+ * databases, so that any change in those makes the old file irrelevant.
+ */
+
+void
+da_cache_set_dir(
+    const char* dir)
+    G_GNUC_INTERNAL;
+
+/* Returns NULL if the cache is disabled */
+char*
+da_cache_path(
+    const void* spec,
+    gsize len,
+    const DA_ACTION* actions,
+    DA_POLICY_FLAGS flags)
+    G_GNUC_INTERNAL;
+
+DAParser*
+da_cache_load(
+    const char* path,
+    DA_POLICY_FLAGS flags)
+    G_GNUC_INTERNAL;
+
+void
+da_cache_store(
+    const char* path,
+    DAParser* parser)
+    G_GNUC_INTERNAL;
+
+#endif /* DBUSACCESS_CACHE_H */
+
+/*
+ * Local Variables:
+ * mode: C
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
@@ -31,6 +31,34 @@
  */
 
 #include "dbusaccess_cred_p.h"
+#include "dbusaccess_weak_table.h"
+
+#include <gutil_macros.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct da_cred_prepared_priv {
+    DACredPrepared pub;
+    gid_t* groups;
+    guint64 groups_mask; /* Bit (gid % 64) is set for each group */
+    gboolean interned;   /* TRUE if it's in da_cred_interned */
+    gint ref_count;
+} DACredPreparedPriv;
+
+static inline DACredPreparedPriv*
+da_cred_prepared_cast(const DACredPrepared* prepared)
+    { return G_CAST(prepared, DACredPreparedPriv, pub); }
+
+#define DA_CRED_GROUP_BIT(gid) (G_GUINT64_CONSTANT(1) << ((gid) % 64))
+
+/*
+ * Interned credentials are weakly referenced by da_cred_interned table.
+ * The last reference to an interned record is only released under the
+ * lock, so that da_cred_prepared_intern never picks up a dying one.
+ */
+G_LOCK_DEFINE_STATIC(da_cred_interned);
+static GHashTable* da_cred_interned = NULL;
 
 /* Process status file parsing */
 
@@ -42,18 +70,63 @@
 #define PROC_PARSE_UID_OK   (0x0010)
 #define PROC_PARSE_GID_OK   (0x0020)
 
+/*
+ * Numbers are converted straight from the input buffer, the same way
+ * g_ascii_strtoull would do it, except that the whole word must be
+ * consumed. Base 0 means auto-detection (decimal, octal or hex).
+ */
+static
+gboolean
+da_cred_parse_number(
+    const char* str,
+    const char* end,
+    guint base,
+    guint64* result)
+{
+    gboolean negative = FALSE;
+    gboolean overflow = FALSE;
+    guint64 val = 0;
+
+    if (str < end && (*str == '+' || *str == '-')) {
+        negative = (*str++ == '-');
+    }
+    if ((base == 0 || base == 16) && (end - str) > 2 && str[0] == '0' &&
+        (str[1] == 'x' || str[1] == 'X') && g_ascii_isxdigit(str[2])) {
+        base = 16;
+        str += 2;
+    } else if (!base) {
+        base = (str < end && str[0] == '0') ? 8 : 10;
+    }
+    if (str == end) {
+        return FALSE;
+    }
+    while (str < end) {
+        const int digit = g_ascii_xdigit_value(*str++);
+
+        if (digit < 0 || (guint)digit >= base) {
+            return FALSE;
+        } else if (val > (G_MAXUINT64 - digit) / base) {
+            overflow = TRUE;
+        } else {
+            val = val * base + digit;
+        }
+    }
+    *result = overflow ? G_MAXUINT64 : negative ? (0 - val) : val;
+    return TRUE;
+}
+
 static
 gboolean
 da_cred_parse_uint32(
     const char* str,
+    const char* end,
     guint32* result)
 {
-    char* end = NULL;
-    guint64 val64 = g_ascii_strtoull(str, &end, 0);
-    /* The input string is guaranteed to be non-empty */
-    if (!end[0]) {
+    guint64 val64;
+
+    if (da_cred_parse_number(str, end, 0, &val64)) {
         /* Check for overflow */
-        guint32 val32 = (guint32)val64;
+        const guint32 val32 = (guint32)val64;
         if ((guint64)val32 == val64) {
             *result = val32;
             return TRUE;
@@ -62,143 +135,480 @@ da_cred_parse_uint32(
     return FALSE;
 }
 
+/* Finds the next whitespace-separated word, returns FALSE at the end */
 static
 gboolean
-da_cred_parse_uint64(
-    const char* str,
-    guint64* result)
+da_cred_next_word(
+    const char** ptr,
+    const char* eol,
+    const char** word)
 {
-    char* end = NULL;
-    guint64 val = g_ascii_strtoull(str, &end, 16);
-    /* The input string is guaranteed to be non-empty */
-    if (!end[0]) {
-        *result = val;
+    const char* p = *ptr;
+
+    while (p < eol && g_ascii_isspace(*p)) p++;
+    if (p < eol) {
+        *word = p;
+        while (p < eol && !g_ascii_isspace(*p)) p++;
+        *ptr = p;
         return TRUE;
     }
+    *ptr = p;
     return FALSE;
 }
 
 static
-const char*
-da_cred_parse_values(
-    GPtrArray* vals,
-    const char* data,
-    const char* end)
+guint
+da_cred_count_words(
+    const char* ptr,
+    const char* eol)
 {
-    const char* ptr = data;
-    const char* eol = data;
-    g_ptr_array_set_size(vals, 0);
-    g_ptr_array_set_free_func(vals, g_free);
-    /* Find the end of line */
-    while (eol < end && *eol != '\n') eol++;
-    /* Skip spaces before the first word */
-    while (ptr < eol && g_ascii_isspace(*ptr)) ptr++;
-    /* Parse values word by word */
-    while (ptr < eol) {
-        const char* word = ptr;
-        while (ptr < eol && !g_ascii_isspace(*ptr)) ptr++;
-        g_ptr_array_add(vals, g_strndup(word, ptr - word));
-        /* Skip spaces after the word */
-        while (ptr < eol && g_ascii_isspace(*ptr)) ptr++;
-    }
-    return ptr;
+    const char* word;
+    guint n = 0;
+
+    while (da_cred_next_word(&ptr, eol, &word)) n++;
+    return n;
 }
 
+/* Parses the second of four numbers (the effective id) */
 static
 gboolean
-da_cred_match(
-    const char* key,
-    const char* str,
-    gsize len)
+da_cred_parse_id(
+    const char* ptr,
+    const char* eol,
+    guint32* id)
+{
+    const char* word;
+    guint32 value = 0;
+    guint n = 0;
+
+    while (da_cred_next_word(&ptr, eol, &word)) {
+        if (++n == 2 && !da_cred_parse_uint32(word, ptr, &value)) {
+            return FALSE;
+        }
+    }
+    if (n == 4) {
+        *id = value;
+        return TRUE;
+    }
+    return FALSE;
+}
+
+static
+void
+da_cred_parse_groups(
+    DACred* cred,
+    DACredPriv* priv,
+    const char* ptr,
+    const char* eol)
 {
-    return (!g_ascii_strncasecmp(key, str, len) && !key[len]);
+    const guint n = da_cred_count_words(ptr, eol);
+
+    if (n > 0) {
+        const char* word;
+
+        /* Numbers go straight to their final location */
+        da_cred_priv_groups(priv, n);
+        while (da_cred_next_word(&ptr, eol, &word)) {
+            guint32 g;
+            /* Should we clear the DBUSACCESS_CRED_GROUPS
+             * if parsing fails? */
+            if (da_cred_parse_uint32(word, ptr, &g)) {
+                priv->groups[cred->ngroups++] = g;
+            }
+        }
+        if (cred->ngroups > 0) {
+            cred->groups = priv->groups;
+        }
+    }
 }
 
+/*
+ * Tests whether the line starts with the key immediately followed by
+ * the colon. Keys are case insensitive.
+ */
+#define da_cred_key(ptr,eol,key) \
+    da_cred_key_match(ptr, eol, key, sizeof(key) - 1)
+
+static inline
 gboolean
-da_cred_parse(
+da_cred_key_match(
+    const char* ptr,
+    const char* eol,
+    const char* key,
+    gsize keylen)
+{
+    return (gsize)(eol - ptr) > keylen && ptr[keylen] == ':' &&
+        !g_ascii_strncasecmp(ptr, key, keylen);
+}
+
+static
+void
+da_cred_parser_line(
+    DACredParser* parser,
+    const char* ptr,
+    const char* eol)
+{
+    /* We are at the first non-empty character of the line */
+    DACred* cred = parser->cred;
+
+    /*
+     * The first character is enough to reject most of the lines,
+     * there's no need to look for the end of the key.
+     */
+    switch (*ptr | 0x20) {
+    case 'u':
+        if (!(parser->state & PROC_PARSE_UID) &&
+            da_cred_key(ptr, eol, "Uid")) {
+            /* Real, effective, saved set, and filesystem UIDs */
+            guint32 uid;
+            parser->state |= PROC_PARSE_UID;
+            if (da_cred_parse_id(ptr + 4, eol, &uid)) {
+                parser->state |= PROC_PARSE_UID_OK;
+                cred->euid = uid;
+            }
+        }
+        break;
+    case 'g':
+        if (!(parser->state & PROC_PARSE_GID) &&
+            da_cred_key(ptr, eol, "Gid")) {
+            /* Real, effective, saved set, and filesystem GIDs */
+            guint32 gid;
+            parser->state |= PROC_PARSE_GID;
+            if (da_cred_parse_id(ptr + 4, eol, &gid)) {
+                parser->state |= PROC_PARSE_GID_OK;
+                cred->egid = gid;
+            }
+        } else if (!(parser->state & PROC_PARSE_GROUPS) &&
+            da_cred_key(ptr, eol, "Groups")) {
+            /* Supplementary group list */
+            parser->state |= PROC_PARSE_GROUPS;
+            cred->flags |= DBUSACCESS_CRED_GROUPS;
+            da_cred_parse_groups(cred, parser->priv, ptr + 7, eol);
+        }
+        break;
+    case 'c':
+        if (!(parser->state & PROC_PARSE_CAP_EFF) &&
+            da_cred_key(ptr, eol, "CapEff")) {
+            /* Effective capability set */
+            const char* word;
+            parser->state |= PROC_PARSE_CAP_EFF;
+            ptr += 7;
+            if (da_cred_next_word(&ptr, eol, &word) &&
+                da_cred_count_words(ptr, eol) == 0 &&
+                da_cred_parse_number(word, ptr, 16, &cred->caps)) {
+                cred->flags |= DBUSACCESS_CRED_CAPS;
+            }
+        }
+        break;
+    }
+}
+
+void
+da_cred_parser_init(
+    DACredParser* parser,
     DACred* cred,
     DACredPriv* priv,
+    guint32 fields)
+{
+    parser->cred = cred;
+    parser->priv = priv;
+    parser->state = 0;
+    /* Fields which the caller doesn't need are marked as parsed */
+    if (!(fields & DBUSACCESS_CRED_GROUPS)) {
+        parser->state |= PROC_PARSE_GROUPS;
+    }
+    if (!(fields & DBUSACCESS_CRED_CAPS)) {
+        parser->state |= PROC_PARSE_CAP_EFF;
+    }
+}
+
+gsize
+da_cred_parser_feed(
+    DACredParser* parser,
     const char* data,
-    gsize len)
+    gsize len,
+    gboolean last)
 {
-    guint flags = 0;
     const char* ptr = data;
     const char* eof = data + len;
-    GPtrArray* val = g_ptr_array_new_with_free_func(g_free);
-    while (ptr < eof && (flags & PROC_PARSE_ALL) != PROC_PARSE_ALL) {
+
+    while (ptr < eof && !da_cred_parser_done(parser)) {
         while (ptr < eof && g_ascii_isspace(*ptr)) ptr++;
         if (ptr < eof) {
-            /* We are at the first non-empty character of the line */
-            const char* start = ptr;
-            while (ptr < eof && !g_ascii_isspace(*ptr) && *ptr != ':') ptr++;
-            if (ptr < eof) {
-                if (*ptr == ':') {
-                    /* We've got the key */
-                    const gsize keylen = ptr - start;
-                    /* Skip the delimiter */
-                    ptr++;
-                    if (!(flags & PROC_PARSE_UID) &&
-                        da_cred_match("Uid", start, keylen)) {
-                        /* Real, effective, saved set, and filesystem UIDs */
-                        guint32 uid;
-                        flags |= PROC_PARSE_UID;
-                        ptr = da_cred_parse_values(val, ptr, eof);
-                        if (val->len == 4 &&
-                            da_cred_parse_uint32(val->pdata[1], &uid)) {
-                            flags |= PROC_PARSE_UID_OK;
-                            cred->euid = uid;
-                        }
-                    } else if (!(flags & PROC_PARSE_GID) &&
-                               da_cred_match("Gid", start, keylen)) {
-                        /* Real, effective, saved set, and filesystem GIDs */
-                        guint32 gid;
-                        flags |= PROC_PARSE_GID;
-                        ptr = da_cred_parse_values(val, ptr, eof);
-                        if (val->len == 4 &&
-                            da_cred_parse_uint32(val->pdata[1], &gid)) {
-                            flags |= PROC_PARSE_GID_OK;
-                            cred->egid = gid;
-                        }
-                    } else if (!(flags & PROC_PARSE_GROUPS) &&
-                               da_cred_match("Groups", start, keylen)) {
-                        /* Supplementary group list */
-                        flags |= PROC_PARSE_GROUPS;
-                        cred->flags |= DBUSACCESS_CRED_GROUPS;
-                        ptr = da_cred_parse_values(val, ptr, eof);
-                        if (val->len > 0) {
-                            guint i;
-                            priv->groups = g_new(gid_t, val->len);
-                            for (i=0; i<val->len; i++) {
-                                guint32 g;
-                                /* Should we clear the DBUSACCESS_CRED_GROUPS
-                                 * if parsing fails? */
-                                if (da_cred_parse_uint32(val->pdata[i], &g)) {
-                                    priv->groups[cred->ngroups++] = g;
-                                }
-                            }
-                            if (cred->ngroups > 0) {
-                                cred->groups = priv->groups;
-                            }
-                        }
-                    } else if (!(flags & PROC_PARSE_CAP_EFF) &&
-                               da_cred_match("CapEff", start, keylen)) {
-                        /* Effective capability set */
-                        flags |= PROC_PARSE_CAP_EFF;
-                        ptr = da_cred_parse_values(val, ptr, eof);
-                        if (val->len == 1 &&
-                            da_cred_parse_uint64(val->pdata[0], &cred->caps)) {
-                            cred->flags |= DBUSACCESS_CRED_CAPS;
-                        }
-                    }
-                }
-                /* Skip to the end of line, eat one EOL character */
-                while (ptr < eof && *ptr != '\n') ptr++;
-                if (ptr < eof) ptr++;
+            const char* eol = memchr(ptr, '\n', eof - ptr);
+
+            if (!eol) {
+                eol = eof;
+            }
+            if (eol == eof && !last) {
+                /* Incomplete line, wait for more data */
+                break;
+            }
+            da_cred_parser_line(parser, ptr, eol);
+            /* Skip to the end of line, eat one EOL character */
+            ptr = eol;
+            if (ptr < eof) ptr++;
+        }
+    }
+    return ptr - data;
+}
+
+gboolean
+da_cred_parser_done(
+    const DACredParser* parser)
+{
+    return (parser->state & PROC_PARSE_ALL) == PROC_PARSE_ALL;
+}
+
+gboolean
+da_cred_parser_finish(
+    const DACredParser* parser)
+{
+    return (parser->state & PROC_PARSE_UID_OK) &&
+        (parser->state & PROC_PARSE_GID_OK);
+}
+
+gboolean
+da_cred_parse(
+    DACred* cred,
+    DACredPriv* priv,
+    const char* data,
+    gsize len)
+{
+    DACredParser parser;
+
+    da_cred_parser_init(&parser, cred, priv, DBUSACCESS_CRED_ALL);
+    da_cred_parser_feed(&parser, data, len, TRUE);
+    return da_cred_parser_finish(&parser);
+}
+
+/* Prepared credentials */
+
+static
+int
+da_cred_compare_gid(
+    const void* p1,
+    const void* p2)
+{
+    const gid_t g1 = *(const gid_t*)p1;
+    const gid_t g2 = *(const gid_t*)p2;
+    return (g1 < g2) ? -1 : (g1 > g2) ? 1 : 0;
+}
+
+guint
+da_cred_normalize_groups(
+    gid_t* groups,
+    guint count)
+{
+    guint i, n = 0;
+
+    qsort(groups, count, sizeof(groups[0]), da_cred_compare_gid);
+    for (i = 0; i < count; i++) {
+        if (!n || groups[n - 1] != groups[i]) {
+            groups[n++] = groups[i];
+        }
+    }
+    return n;
+}
+
+/* Takes ownership of the normalized groups */
+static
+DACredPreparedPriv*
+da_cred_prepared_alloc(
+    const DACred* cred,
+    gid_t* groups,
+    guint n)
+{
+    DACredPreparedPriv* priv = g_slice_new0(DACredPreparedPriv);
+    DACred* prep = &priv->pub.cred;
+    guint i;
+
+    *prep = *cred;
+    priv->groups = groups;
+    priv->groups_mask = DA_CRED_GROUP_BIT(cred->egid);
+    priv->ref_count = 1;
+    for (i = 0; i < n; i++) {
+        priv->groups_mask |= DA_CRED_GROUP_BIT(groups[i]);
+    }
+    prep->groups = n ? groups : NULL;
+    prep->ngroups = n;
+    return priv;
+}
+
+DACredPrepared*
+da_cred_prepared_new(
+    const DACred* cred)
+{
+    if (cred) {
+        gid_t* groups = NULL;
+        guint n = 0;
+
+        if (cred->ngroups) {
+            groups = g_memdup(cred->groups,
+                sizeof(cred->groups[0]) * cred->ngroups);
+            n = da_cred_normalize_groups(groups, cred->ngroups);
+        }
+        return &da_cred_prepared_alloc(cred, groups, n)->pub;
+    }
+    return NULL;
+}
+
+static
+guint
+da_cred_hash(
+    gconstpointer key)
+{
+    const DACred* cred = key;
+    guint i, h = cred->euid;
+
+    h = h * 31 + cred->egid;
+    h = h * 31 + (guint)cred->caps;
+    h = h * 31 + (guint)(cred->caps >> 32);
+    h = h * 31 + cred->flags;
+    for (i = 0; i < cred->ngroups; i++) {
+        h = h * 31 + cred->groups[i];
+    }
+    return h;
+}
+
+static
+gboolean
+da_cred_equal(
+    gconstpointer a,
+    gconstpointer b)
+{
+    const DACred* c1 = a;
+    const DACred* c2 = b;
+
+    return c1->euid == c2->euid && c1->egid == c2->egid &&
+        c1->caps == c2->caps && c1->flags == c2->flags &&
+        c1->ngroups == c2->ngroups && (!c1->ngroups ||
+        !memcmp(c1->groups, c2->groups, sizeof(gid_t) * c1->ngroups));
+}
+
+DACredPrepared*
+da_cred_prepared_intern(
+    const DACred* cred)
+{
+    if (cred) {
+        gid_t stack_buf[DA_CRED_INLINE_GROUPS];
+        gid_t* groups = NULL;
+        DACredPrepared* prepared;
+        DACred key = *cred;
+
+        /* The lookup key has the groups normalized */
+        key.groups = NULL;
+        if (cred->ngroups) {
+            groups = (cred->ngroups <= G_N_ELEMENTS(stack_buf)) ?
+                stack_buf : g_new(gid_t, cred->ngroups);
+            memcpy(groups, cred->groups, sizeof(gid_t) * cred->ngroups);
+            key.ngroups = da_cred_normalize_groups(groups, cred->ngroups);
+            key.groups = groups;
+        }
+
+        G_LOCK(da_cred_interned);
+        prepared = da_cred_interned ?
+            g_hash_table_lookup(da_cred_interned, &key) : NULL;
+        if (prepared) {
+            g_atomic_int_inc(&da_cred_prepared_cast(prepared)->ref_count);
+        } else {
+            DACredPreparedPriv* priv;
+
+            if (groups == stack_buf) {
+                groups = g_memdup(stack_buf, sizeof(gid_t) * key.ngroups);
             }
+            priv = da_cred_prepared_alloc(&key, groups, key.ngroups);
+            priv->interned = TRUE;
+            groups = NULL;
+            prepared = &priv->pub;
+            if (!da_cred_interned) {
+                da_cred_interned = g_hash_table_new(da_cred_hash,
+                    da_cred_equal);
+            }
+            g_hash_table_insert(da_cred_interned, &prepared->cred, prepared);
+        }
+        G_UNLOCK(da_cred_interned);
+
+        if (groups != stack_buf) {
+            g_free(groups);
         }
+        return prepared;
     }
-    g_ptr_array_unref(val); 
-    return (flags & PROC_PARSE_UID_OK) && (flags & PROC_PARSE_GID_OK);
+    return NULL;
+}
+
+DACredPrepared*
+da_cred_prepared_ref(
+    DACredPrepared* prepared)
+{
+    if (prepared) {
+        DACredPreparedPriv* priv = da_cred_prepared_cast(prepared);
+        g_atomic_int_inc(&priv->ref_count);
+    }
+    return prepared;
+}
+
+static
+gboolean
+da_cred_prepared_unref_interned(
+    DACredPreparedPriv* priv)
+{
+    return da_weak_table_unref(&priv->ref_count,
+        &G_LOCK_NAME(da_cred_interned), &da_cred_interned, &priv->pub.cred);
+}
+
+void
+da_cred_prepared_unref(
+    DACredPrepared* prepared)
+{
+    if (prepared) {
+        DACredPreparedPriv* priv = da_cred_prepared_cast(prepared);
+        if (priv->interned ? da_cred_prepared_unref_interned(priv) :
+            g_atomic_int_dec_and_test(&priv->ref_count)) {
+            g_free(priv->groups);
+            g_slice_free(DACredPreparedPriv, priv);
+        }
+    }
+}
+
+gboolean
+da_cred_prepared_has_group(
+    const DACredPrepared* prepared,
+    gid_t gid)
+{
+    const DACred* cred = &prepared->cred;
+    if (gid == cred->egid) {
+        return TRUE;
+    } else if (da_cred_prepared_cast(prepared)->groups_mask &
+        DA_CRED_GROUP_BIT(gid)) {
+        /* Binary search in the sorted list */
+        const gid_t* groups = cred->groups;
+        guint lo = 0, hi = cred->ngroups;
+        while (lo < hi) {
+            const guint mid = (lo + hi) / 2;
+            if (groups[mid] < gid) {
+                lo = mid + 1;
+            } else if (groups[mid] > gid) {
+                hi = mid;
+            } else {
+                return TRUE;
+            }
+        }
+    }
+    return FALSE;
+}
+
+/* Private parser data */
+
+gid_t*
+da_cred_priv_groups(
+    DACredPriv* priv,
+    guint n)
+{
+    da_cred_priv_cleanup(priv);
+    priv->groups = (n <= G_N_ELEMENTS(priv->inline_groups)) ?
+        priv->inline_groups : g_new(gid_t, n);
+    return priv->groups;
 }
 
 void
@@ -206,7 +616,9 @@ da_cred_priv_cleanup(
     DACredPriv* priv)
 {
     if (priv->groups) {
-        g_free(priv->groups);
+        if (priv->groups != priv->inline_groups) {
+            g_free(priv->groups);
+        }
         priv->groups = NULL;
     }
 }
@@ -33,12 +33,56 @@
 #ifndef DBUSACCESS_CRED_PRIVATE_H
 #define DBUSACCESS_CRED_PRIVATE_H
 
-#include "dbusaccess_types.h"
+#include "dbusaccess_cred.h"
+
+/* Most processes have only a handful of supplementary groups */
+#define DA_CRED_INLINE_GROUPS (32)
 
 typedef struct da_cred_priv {
     gid_t* groups;
+    gid_t inline_groups[DA_CRED_INLINE_GROUPS];
 } DACredPriv;
 
+/*
+ * Incremental /proc/<pid>/status parser. The input is fed in chunks,
+ * only complete lines are consumed. Parsing is done as soon as all
+ * requested fields have been seen, the rest of the file can be skipped.
+ */
+typedef struct da_cred_parser {
+    DACred* cred;
+    DACredPriv* priv;
+    guint state;
+} DACredParser;
+
+void
+da_cred_parser_init(
+    DACredParser* parser,
+    DACred* cred,
+    DACredPriv* priv,
+    guint32 fields)
+    G_GNUC_INTERNAL;
+
+/* Returns the number of bytes consumed */
+gsize
+da_cred_parser_feed(
+    DACredParser* parser,
+    const char* data,
+    gsize len,
+    gboolean last)
+    G_GNUC_INTERNAL;
+
+/* TRUE if no more input is needed */
+gboolean
+da_cred_parser_done(
+    const DACredParser* parser)
+    G_GNUC_INTERNAL;
+
+/* TRUE if the mandatory fields have been parsed */
+gboolean
+da_cred_parser_finish(
+    const DACredParser* parser)
+    G_GNUC_INTERNAL;
+
 gboolean
 da_cred_parse(
     DACred* cred,
@@ -47,11 +91,31 @@ da_cred_parse(
     gsize len)
     G_GNUC_INTERNAL;
 
+/* Storage for n groups, inline if they fit */
+gid_t*
+da_cred_priv_groups(
+    DACredPriv* priv,
+    guint n)
+    G_GNUC_INTERNAL;
+
 void
 da_cred_priv_cleanup(
     DACredPriv* priv)
     G_GNUC_INTERNAL;
 
+/* Sorts the groups and drops the duplicates, returns the new count */
+guint
+da_cred_normalize_groups(
+    gid_t* groups,
+    guint count)
+    G_GNUC_INTERNAL;
+
+gboolean
+da_cred_prepared_has_group(
+    const DACredPrepared* prepared,
+    gid_t gid)
+    G_GNUC_INTERNAL;
+
 #endif /* DBUSACCESS_CRED_PRIVATE_H */
 
 /*
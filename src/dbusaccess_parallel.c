@@ -0,0 +1,122 @@
+/*
+ * Copyright (C) 2026 Jolla Ltd.
+ *
+ * You may use this file under the terms of BSD license as follows:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *   3. Neither the names of the copyright holders nor the names of its
+ *      contributors may be used to endorse or promote products derived
+ *      from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "dbusaccess_parallel.h"
+#include "dbusaccess_log.h"
+
+#include <string.h>
+#include <unistd.h>
+
+typedef struct da_parallel {
+    DAParallelStartFunc start;
+    DAParallelFunc fn;
+    GDestroyNotify finish;
+    gpointer data;
+    guint count;
+    gint next;              /* Atomic, the next index to process */
+    gint done;              /* Atomic, number of successful calls */
+} DAParallel;
+
+static
+void
+da_parallel_worker(
+    gpointer data,
+    gpointer user_data)
+{
+    DAParallel* job = data;
+    gpointer state = job->start ? job->start(job->data) : NULL;
+    guint i;
+
+    /* Each worker grabs the next index until there's none left */
+    while ((i = (guint)g_atomic_int_add(&job->next, 1)) < job->count) {
+        if (job->fn(i, state, job->data)) {
+            g_atomic_int_inc(&job->done);
+        }
+    }
+    if (job->finish) {
+        job->finish(state);
+    }
+}
+
+guint
+da_parallel_for(
+    guint count,
+    guint max_threads,
+    DAParallelStartFunc start,
+    DAParallelFunc fn,
+    GDestroyNotify finish,
+    gpointer data)
+{
+    DAParallel job;
+    guint threads = max_threads;
+
+    if (!threads) {
+        const long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = (ncpu > 0) ? (guint)ncpu : 1;
+    }
+    threads = MIN(threads, count);
+
+    memset(&job, 0, sizeof(job));
+    job.start = start;
+    job.fn = fn;
+    job.finish = finish;
+    job.data = data;
+    job.count = count;
+    if (threads > 1) {
+        GError* error = NULL;
+        GThreadPool* pool = g_thread_pool_new(da_parallel_worker, NULL,
+            threads - 1, FALSE, &error);
+
+        if (pool) {
+            guint i;
+
+            for (i = 1; i < threads; i++) {
+                g_thread_pool_push(pool, &job, NULL);
+            }
+            /* The calling thread is working too */
+            da_parallel_worker(&job, NULL);
+            g_thread_pool_free(pool, FALSE, TRUE);
+            return job.done;
+        }
+        GWARN("%s", GERRMSG(error));
+        g_error_free(error);
+    }
+    da_parallel_worker(&job, NULL);
+    return job.done;
+}
+
+/*
+ * Local Variables:
+ * mode: C
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
@@ -31,14 +31,37 @@
  */
 
 #include "dbusaccess_parser_p.h"
+#include "dbusaccess_action_p.h"
+#include "dbusaccess_system.h"
 #include "dbusaccess_log.h"
 
+/*
+ * Everything allocated by the parser lives in a simple bump arena,
+ * which is released in one go by da_parser_delete.
+ */
+
+typedef struct da_parser_block DAParserBlock;
+
+struct da_parser_block {
+    DAParserBlock* next;
+    gsize size;
+    gsize used;
+};
+
+#define DA_PARSER_ALIGN(n) (((n) + 7) & ~((gsize)7))
+#define DA_PARSER_BLOCK_HEADER DA_PARSER_ALIGN(sizeof(DAParserBlock))
+#define DA_PARSER_BLOCK_SIZE (4096 - DA_PARSER_BLOCK_HEADER)
+#define DA_PARSER_BLOCK_DATA(b) (((char*)(b)) + DA_PARSER_BLOCK_HEADER)
+
 struct da_parser {
     const DA_ACTION* actions;
+    DAActionTable* table;
+    DA_POLICY_FLAGS flags;
+    DAScanner* scanner;
     GString* buf;
-    GSList* alloc_list;
-    GSList* link_list;
+    DAParserBlock* blocks;
     GSList* entries;
+    gboolean unresolved; /* Some names couldn't be resolved */
 };
 
 void
@@ -65,12 +88,77 @@ da_parser_append_char(
     g_string_append_c(parser->buf, c);
 }
 
+void
+da_parser_append_string(
+    DAParser* parser,
+    const char* str,
+    gsize len)
+{
+    g_string_append_len(parser->buf, str, len);
+}
+
+static
+DAParserBlock*
+da_parser_block_new(
+    gsize size,
+    DAParserBlock* next)
+{
+    DAParserBlock* block = g_malloc(DA_PARSER_BLOCK_HEADER + size);
+    block->next = next;
+    block->size = size;
+    block->used = 0;
+    return block;
+}
+
+void*
+da_parser_alloc(
+    DAParser* parser,
+    gsize size)
+{
+    DAParserBlock* block = parser->blocks;
+    void* ptr;
+
+    size = DA_PARSER_ALIGN(size);
+    if (!block || (block->used + size) > block->size) {
+        if (size > DA_PARSER_BLOCK_SIZE / 4) {
+            /* Large chunks get a block of their own */
+            block = da_parser_block_new(size, NULL);
+            if (parser->blocks) {
+                /* Keep allocating from the current block */
+                block->next = parser->blocks->next;
+                parser->blocks->next = block;
+            } else {
+                parser->blocks = block;
+            }
+        } else {
+            parser->blocks = block = da_parser_block_new(DA_PARSER_BLOCK_SIZE,
+                parser->blocks);
+        }
+    }
+    ptr = DA_PARSER_BLOCK_DATA(block) + block->used;
+    block->used += size;
+    return ptr;
+}
+
+char*
+da_parser_new_string(
+    DAParser* parser,
+    const char* str,
+    gsize len)
+{
+    char* copy = da_parser_alloc(parser, len + 1);
+    memcpy(copy, str, len);
+    copy[len] = 0;
+    return copy;
+}
+
 const char*
 da_parser_finish_string(
     DAParser* parser)
 {
-    char* str = da_parser_new_string(parser, parser->buf->str);
-    g_string_set_size(parser->buf, 0);
+    GString* buf = parser->buf;
+    char* str = da_parser_new_string(parser, buf->str, buf->len);
+    g_string_set_size(buf, 0);
     return str;
 }
 
@@ -80,7 +168,9 @@ da_parser_find_action(
     DAParser* parser,
     const char* name)
 {
-    if (name && parser->actions) {
+    if (parser->table) {
+        return da_action_table_find(parser->table, name);
+    } else if (name && parser->actions) {
         const DA_ACTION* action = parser->actions;
         while (action->name) {
             if (!g_strcmp0(name, action->name)) {
@@ -95,35 +185,79 @@ da_parser_find_action(
 GSList*
 da_parser_new_link(
     DAParser* parser,
-    void* data)
+    void* data,
+    GSList* next)
 {
-    GSList* link = g_slist_append(NULL, NULL);
-    parser->link_list = g_slist_prepend(parser->link_list, link);
+    /* These links must never be freed with g_slist_free & co */
+    GSList* link = da_parser_alloc(parser, sizeof(GSList));
     link->data = data;
+    link->next = next;
     return link;
 }
 
-char*
-da_parser_new_string(
+static
+DAParserId
+da_parser_resolve(
     DAParser* parser,
-    const char* str)
+    const char* name,
+    int (*resolve)(const char* name),
+    const char* what)
 {
-    char* copy = g_strdup(str);
-    parser->alloc_list = g_slist_prepend(parser->alloc_list, copy);
-    return copy;
+    DAParserId result;
+    if (parser->flags & DA_POLICY_FLAG_LAZY_NAMES) {
+        /* Name is already allocated by the parser */
+        result.id = DA_UNRESOLVED;
+        result.name = name;
+    } else {
+        result.id = resolve(name);
+        result.name = NULL;
+        if (result.id < 0) {
+            GDEBUG("Unknown %s \"%s\"", what, name);
+            result.id = DA_INVALID;
+            parser->unresolved = TRUE;
+        }
+    }
+    return result;
+}
+
+DAParserId
+da_parser_user(
+    DAParser* parser,
+    const char* name)
+{
+    return da_parser_resolve(parser, name, da_system_uid, "user");
+}
+
+DAParserId
+da_parser_group(
+    DAParser* parser,
+    const char* name)
+{
+    return da_parser_resolve(parser, name, da_system_gid, "group");
 }
 
 DAParserExpr*
 da_parser_new_expr_identity(
     DAParser* parser,
-    int uid,
-    int gid)
+    const DAParserId* user,
+    const DAParserId* group)
 {
-    DAParserExpr* expr = g_new(DAParserExpr,1);
-    parser->alloc_list = g_slist_prepend(parser->alloc_list, expr);
+    DAParserExpr* expr = da_parser_alloc(parser, sizeof(DAParserExpr));
     expr->type = DA_PARSER_EXPR_IDENTITY;
-    expr->data.identity.uid = uid;
-    expr->data.identity.gid = gid;
+    if (user) {
+        expr->data.identity.uid = user->id;
+        expr->data.identity.user = user->name;
+    } else {
+        expr->data.identity.uid = DA_WILDCARD;
+        expr->data.identity.user = NULL;
+    }
+    if (group) {
+        expr->data.identity.gid = group->id;
+        expr->data.identity.group = group->name;
+    } else {
+        expr->data.identity.gid = DA_WILDCARD;
+        expr->data.identity.group = NULL;
+    }
     return expr;
 }
 
@@ -141,8 +275,7 @@ da_parser_new_expr_custom(
     } else if (!param && action->args) {
         GDEBUG("Missing parameter for \"%s\"", name);
     } else {
-        DAParserExpr* expr = g_new(DAParserExpr,1);
-        parser->alloc_list = g_slist_prepend(parser->alloc_list, expr);
+        DAParserExpr* expr = da_parser_alloc(parser, sizeof(DAParserExpr));
         expr->type = DA_PARSER_EXPR_CUSTOM;
         expr->data.custom.action = action->id;
         expr->data.custom.param = param;
@@ -158,8 +291,7 @@ da_parser_new_expr(
     DAParserExpr* left,
     DAParserExpr* right)
 {
-    DAParserExpr* expr = g_new0(DAParserExpr, 1);
-    parser->alloc_list = g_slist_prepend(parser->alloc_list, expr);
+    DAParserExpr* expr = da_parser_alloc(parser, sizeof(DAParserExpr));
     GASSERT(type != DA_PARSER_EXPR_IDENTITY);
     GASSERT(type != DA_PARSER_EXPR_CUSTOM);
     expr->type = type;
@@ -174,8 +306,7 @@ da_parser_new_entry(
     DAParserExpr* expr,
     DA_ACCESS access)
 {
-    DAParserEntry* entry = g_new(DAParserEntry,1);
-    parser->alloc_list = g_slist_prepend(parser->alloc_list, entry);
+    DAParserEntry* entry = da_parser_alloc(parser, sizeof(DAParserEntry));
     entry->expr = expr;
     entry->access = access;
     return entry;
@@ -186,60 +317,118 @@ da_parser_add_entries(
     DAParser* parser,
     GSList* entries)
 {
-    parser->entries = g_slist_concat(parser->entries, entries);
+    /* Entries are prepended by the grammar rules, restore the order */
+    parser->entries = g_slist_concat(parser->entries,
+        g_slist_reverse(entries));
 }
 
-static
 DAParser*
-da_parser_create(
-    const DA_ACTION* actions)
+da_parser_new(
+    const DA_ACTION* actions,
+    DAActionTable* table,
+    DA_POLICY_FLAGS flags)
 {
     DAParser* parser = g_slice_new0(DAParser);
     parser->buf = g_string_new(NULL);
-    parser->actions = actions;
+    if (table) {
+        parser->table = da_action_table_ref(table);
+    } else {
+        parser->actions = actions;
+    }
+    parser->flags = flags;
     return parser;
 }
 
 static
 void
-da_parser_free_link(
-    gpointer data)
+da_parser_reset(
+    DAParser* parser)
 {
-    g_slist_free_1(data);
+    DAParserBlock* block = parser->blocks;
+
+    /* Keep one regular block for the next run */
+    if (block && block->size == DA_PARSER_BLOCK_SIZE) {
+        parser->blocks = block;
+        block->used = 0;
+        block = block->next;
+        parser->blocks->next = NULL;
+    } else {
+        parser->blocks = NULL;
+    }
+    while (block) {
+        DAParserBlock* next = block->next;
+        g_free(block);
+        block = next;
+    }
+    g_string_set_size(parser->buf, 0);
+    parser->entries = NULL;
+    parser->unresolved = FALSE;
 }
 
 void
 da_parser_delete(
     DAParser* parser)
 {
-    g_slist_free_full(parser->link_list, da_parser_free_link);
-    g_slist_free_full(parser->alloc_list, g_free);
+    da_parser_reset(parser);
+    g_free(parser->blocks);
+    if (parser->scanner) {
+        da_scanner_delete(parser->scanner);
+    }
+    da_action_table_unref(parser->table);
     g_string_free(parser->buf, TRUE);
     g_slice_free(DAParser, parser);
 }
 
-DAParser*
-da_parser_compile(
-    const char* spec,
-    const DA_ACTION* actions)
+gboolean
+da_parser_parse_buffer(
+    DAParser* parser,
+    const void* data,
+    gsize len)
 {
-    if (spec) {
-        DAParser* parser = da_parser_create(actions);
-        DAScanner* scanner = da_scanner_create();
-        int result = -1;
-        if (scanner) {
-            DAScannerBuffer* buf = da_scanner_buffer_create(spec, scanner);
-            if (buf) {
+    int result = -1;
+
+    /* Whatever has been parsed before is gone */
+    da_parser_reset(parser);
+    if (!parser->scanner) {
+        parser->scanner = da_scanner_create();
+    }
+    if (parser->scanner && (data || !len)) {
+        DAScanner* scanner = parser->scanner;
+        DAScannerInput input;
+        DAScannerBuffer* buf;
+
+        input.ptr = data;
+        input.left = len;
+        buf = da_scanner_buffer_create(&input, scanner);
+        if (buf) {
 #ifdef DEBUG
-                da_parser_debug = gutil_log_default.level >= GLOG_LEVEL_DEBUG;
-#endif
-                GDEBUG("Parsing \"%s\"", spec);
-                result = da_parser_parse(parser, scanner);
-                da_scanner_buffer_delete(buf, scanner);
+            /*
+             * yydebug is a global variable and parsers may be running
+             * on multiple threads. Avoid pointless writes to it.
+             */
+            const int debug = gutil_log_default.level >= GLOG_LEVEL_DEBUG;
+            if (g_atomic_int_get(&da_parser_debug) != debug) {
+                g_atomic_int_set(&da_parser_debug, debug);
             }
-            da_scanner_delete(scanner);
+#endif
+            GDEBUG("Parsing \"%.*s\"", (int)len, (const char*)data);
+            result = da_parser_parse(parser, scanner);
+            da_scanner_buffer_delete(buf, scanner);
         }
-        if (result == 0) {
+    }
+    return result == 0;
+}
+
+DAParser*
+da_parser_compile_buffer(
+    const void* data,
+    gsize len,
+    const DA_ACTION* actions,
+    DA_POLICY_FLAGS flags)
+{
+    if (data || !len) {
+        DAParser* parser = da_parser_new(actions, NULL, flags);
+        if (da_parser_parse_buffer(parser, data, len)) {
             return parser;
         }
         da_parser_delete(parser);
@@ -247,6 +436,16 @@ da_parser_compile(
     return NULL;
 }
 
+DAParser*
+da_parser_compile(
+    const char* spec,
+    const DA_ACTION* actions,
+    DA_POLICY_FLAGS flags)
+{
+    return spec ? da_parser_compile_buffer(spec, strlen(spec), actions,
+        flags) : NULL;
+}
+
 GSList*
 da_parser_get_result(
     DAParser* parser)
@@ -254,6 +453,13 @@ da_parser_get_result(
     return parser->entries;
 }
 
+gboolean
+da_parser_has_unresolved_names(
+    DAParser* parser)
+{
+    return parser->unresolved;
+}
+
 /*
  * Local Variables:
  * mode: C
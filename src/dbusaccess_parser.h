@@ -48,6 +48,12 @@ typedef enum {
 
 #define DA_WILDCARD (-1) /* Matches any GID or UID */
 #define DA_INVALID  (-2) /* Never matches anything, even another DA_INVALID */
+#define DA_UNRESOLVED (-3) /* Name is to be resolved on the first use */
+
+typedef struct da_parser_id {
+    int id;
+    const char* name; /* Non-NULL only if id is DA_UNRESOLVED */
+} DAParserId;
 
 struct da_parser_expr {
     DA_PARSER_EXPR type;
@@ -55,6 +61,8 @@ struct da_parser_expr {
         struct {
             int uid;
             int gid;
+            const char* user;  /* Set if uid is DA_UNRESOLVED */
+            const char* group; /* Set if gid is DA_UNRESOLVED */
         } identity;
         struct {
             guint action;
@@ -69,10 +77,40 @@ typedef struct da_parser_entry {
     DA_ACCESS access;
 } DAParserEntry;
 
+/*
+ * da_parser_new and da_parser_parse_buffer allow to reuse the same
+ * parser (and the scanner, and the memory it has allocated) for many
+ * policies. Results of the previous run are discarded by the next one.
+ */
+
+/* If the table is provided, actions are ignored */
+DAParser*
+da_parser_new(
+    const DA_ACTION* actions,
+    DAActionTable* table,
+    DA_POLICY_FLAGS flags)
+    G_GNUC_INTERNAL;
+
+gboolean
+da_parser_parse_buffer(
+    DAParser* parser,
+    const void* data,
+    gsize len)
+    G_GNUC_INTERNAL;
+
 DAParser*
 da_parser_compile(
     const char* spec,
-    const DA_ACTION* actions)
+    const DA_ACTION* actions,
+    DA_POLICY_FLAGS flags)
+    G_GNUC_INTERNAL;
+
+DAParser*
+da_parser_compile_buffer(
+    const void* data,
+    gsize len,
+    const DA_ACTION* actions,
+    DA_POLICY_FLAGS flags)
     G_GNUC_INTERNAL;
 
 GSList*
@@ -80,6 +118,12 @@ da_parser_get_result(
     DAParser* parser)
     G_GNUC_INTERNAL;
 
+/* TRUE if the result depends on failed user or group lookups */
+gboolean
+da_parser_has_unresolved_names(
+    DAParser* parser)
+    G_GNUC_INTERNAL;
+
 void
 da_parser_delete(
     DAParser* parser)
@@ -40,6 +40,12 @@
 typedef struct yyguts_t DAScanner;
 typedef struct yy_buffer_state DAScannerBuffer;
 
+/* Input is fed to the scanner in chunks, it's never copied as a whole */
+typedef struct da_scanner_input {
+    const char* ptr;
+    gsize left;
+} DAScannerInput;
+
 #ifdef DEBUG
 #  define YYDEBUG 1
 extern int da_parser_debug G_GNUC_INTERNAL;
@@ -75,7 +81,7 @@ da_scanner_delete(
 
 DAScannerBuffer*
 da_scanner_buffer_create(
-    const char* str,
+    DAScannerInput* input,
     DAScanner* scanner)
     G_GNUC_INTERNAL;
 
@@ -104,6 +110,13 @@ da_parser_append_char(
     char c)
     G_GNUC_INTERNAL;
 
+void
+da_parser_append_string(
+    DAParser* parser,
+    const char* str,
+    gsize len)
+    G_GNUC_INTERNAL;
+
 const char*
 da_parser_finish_string(
     DAParser* parser)
@@ -114,20 +127,41 @@ da_parser_finish_string(
 GSList*
 da_parser_new_link(
     DAParser* parser,
-    void* data)
+    void* data,
+    GSList* next)
+    G_GNUC_INTERNAL;
+
+void*
+da_parser_alloc(
+    DAParser* parser,
+    gsize size)
     G_GNUC_INTERNAL;
 
 char*
 da_parser_new_string(
     DAParser* parser,
-    const char* str)
+    const char* str,
+    gsize len)
+    G_GNUC_INTERNAL;
+
+DAParserId
+da_parser_user(
+    DAParser* parser,
+    const char* name)
+    G_GNUC_INTERNAL;
+
+DAParserId
+da_parser_group(
+    DAParser* parser,
+    const char* name)
     G_GNUC_INTERNAL;
 
+/* NULL user or group means wildcard */
 DAParserExpr*
 da_parser_new_expr_identity(
     DAParser* parser,
-    int uid,
-    int gid)
+    const DAParserId* user,
+    const DAParserId* group)
     G_GNUC_INTERNAL;
 
 DAParserExpr*
@@ -152,6 +186,7 @@ da_parser_new_entry(
     DA_ACCESS access)
     G_GNUC_INTERNAL;
 
+/* Takes the list of entries in reverse order */
 void
 da_parser_add_entries(
     DAParser* parser,
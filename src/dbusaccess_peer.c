@@ -31,13 +31,15 @@
  */
 
 #include "dbusaccess_peer.h"
-#include "dbusaccess_cred_p.h"
+#include "dbusaccess_procfs.h"
 #include "dbusaccess_log.h"
 
 #include <gio/gio.h>
 
 #include <gutil_macros.h>
 
+#include <string.h>
+
 /* Log module */
 GLOG_MODULE_DEFINE("dbusaccess");
 
@@ -50,9 +52,11 @@ typedef struct da_peer_bus {
 
 typedef struct da_peer_priv {
     DAPeer pub;
-    DACredPriv cred;
+    DACredPrepared* prepared; /* Interned, owns pub.cred.groups */
+    GSList* retired;          /* Replaced by refresh, may still be used */
     DAPeerBus* bus;
     char* name;
+    guint32 fields;
     gint ref_count;
     guint timeout_id;
     guint name_watch_id;
@@ -209,7 +213,8 @@ da_peer_finalize(
     if (priv->timeout_id) {
         g_source_remove(priv->timeout_id);
     }
-    da_cred_priv_cleanup(&priv->cred);
+    da_cred_prepared_unref(priv->prepared);
+    g_slist_free_full(priv->retired, (GDestroyNotify)da_cred_prepared_unref);
     g_free(priv->name);
 }
 
@@ -241,23 +246,27 @@ static
 gboolean
 da_peer_fill_cred(
     DAPeerPriv* priv,
-    guint pid)
+    guint pid,
+    guint32 fields)
 {
-    char* fname = g_strdup_printf("/proc/%u/status", pid);
-    GError* error = NULL;
-    gchar* data = NULL;
-    gsize len = 0;
+    DACred cred;
+    DACredPriv cred_priv;
     gboolean ok;
-    if (g_file_get_contents(fname, &data, &len, &error)) {
-        GDEBUG("Parsing %s", fname);
-        ok = da_cred_parse(&priv->pub.cred, &priv->cred, data, len);
-        g_free(data);
-    } else {
-        GDEBUG("%s: %s", fname, GERRMSG(error));
-        g_error_free(error);
-        ok = FALSE;
+
+    memset(&cred, 0, sizeof(cred));
+    memset(&cred_priv, 0, sizeof(cred_priv));
+    ok = da_procfs_read_cred(pid, &cred, &cred_priv, fields);
+    if (ok) {
+        if (priv->prepared) {
+            /* Callers may still be holding pointers to the old data */
+            priv->retired = g_slist_prepend(priv->retired, priv->prepared);
+        }
+        /* Peers with identical credentials share one copy of them */
+        priv->fields = fields;
+        priv->prepared = da_cred_prepared_intern(&cred);
+        priv->pub.cred = priv->prepared->cred;
     }
-    g_free(fname);
+    da_cred_priv_cleanup(&cred_priv);
     return ok;
 }
 
@@ -265,6 +274,15 @@ DAPeer*
 da_peer_get(
     DA_BUS type,
     const char* name)
+{
+    return da_peer_get_full(type, name, DBUSACCESS_CRED_ALL);
+}
+
+DAPeer*
+da_peer_get_full(
+    DA_BUS type,
+    const char* name,
+    guint32 fields)
 {
     if (name) {
         DAPeerBus* bus = da_peer_bus(type, TRUE);
@@ -272,6 +290,18 @@ da_peer_get(
             DAPeerPriv* priv = g_hash_table_lookup(bus->peers, name);
             if (priv) {
                 /* Found cached entry */
+                if ((priv->fields & fields) != fields) {
+                    /*
+                     * It lacks some fields, read them in place. The
+                     * returned pointers are borrowed, the entry must
+                     * stay where it is.
+                     */
+                    GDEBUG("Refreshing '%s'", name);
+                    if (!da_peer_fill_cred(priv, priv->pub.pid,
+                        priv->fields | fields)) {
+                        return NULL;
+                    }
+                }
                 da_peer_reset_timeout(priv);
                 return &priv->pub;
             } else {
@@ -289,7 +319,7 @@ da_peer_get(
                     g_variant_get(ret, "(u)", &pid);
                     g_variant_unref(ret);
                     /* We've got the pid, read /proc/pid/status */
-                    if (da_peer_fill_cred(priv, pid)) {
+                    if (da_peer_fill_cred(priv, pid, fields)) {
                         /* Cache this info */
                         priv->pub.pid = pid;
                         g_hash_table_replace(bus->peers, priv->name, priv);
@@ -308,6 +338,13 @@ da_peer_get(
     return NULL;
 }
 
+const DACredPrepared*
+da_peer_prepared_cred(
+    DAPeer* peer)
+{
+    return peer ? da_peer_cast(peer)->prepared : NULL;
+}
+
 void
 da_peer_flush(
     DA_BUS type,
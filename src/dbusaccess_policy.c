@@ -32,6 +32,12 @@
 
 #include "dbusaccess_policy.h"
 #include "dbusaccess_parser.h"
+#include "dbusaccess_action_p.h"
+#include "dbusaccess_cache.h"
+#include "dbusaccess_parallel.h"
+#include "dbusaccess_weak_table.h"
+#include "dbusaccess_cred_p.h"
+#include "dbusaccess_system.h"
 #include "dbusaccess_log.h"
 
 #include <gutil_macros.h>
@@ -41,6 +47,7 @@ typedef struct da_policy_expr DAPolicyExpr;
 
 typedef struct da_policy_check {
     const DACred* cred;
+    const DACredPrepared* prepared; /* NULL if not prepared */
     guint action;
     const char* arg;
 } DAPolicyCheck;
@@ -74,21 +81,42 @@ typedef struct da_policy_expr_custom {
 
 typedef struct da_policy_expr_identity {
     DAPolicyExpr expr;
-    int uid;
-    int gid;
+    int uid;            /* Atomic, may be DA_UNRESOLVED */
+    int gid;            /* Atomic, may be DA_UNRESOLVED */
+    int retry_time;     /* Atomic, when to try to resolve names again */
+    char* user;         /* Non-NULL if uid was DA_UNRESOLVED */
+    char* group;        /* Non-NULL if gid was DA_UNRESOLVED */
 } DAPolicyExprIdentity;
 
+/* How often to retry resolving unknown names (in seconds) */
+#define DA_POLICY_RESOLVE_RETRY_SEC (5)
+
 struct da_policy_entry {
     DAPolicyEntry* next;
     DA_ACCESS access;
     DAPolicyExpr* expr; /* NULL if wildcard */
 };
 
+struct da_policy_compiler {
+    DAParser* parser;
+    gint ref_count;
+};
+
 struct da_policy {
     gint ref_count;
     DAPolicyEntry* entries;
+    char* shared_key;       /* Non-NULL if it's in da_policy_shared */
+    guint32 cred_fields;    /* DBUSACCESS_CRED_* flags */
 };
 
+/*
+ * Shared policies are weakly referenced by da_policy_shared table.
+ * The last reference to a shared policy is only released under the
+ * lock, so that da_policy_new_shared never picks up a dying policy.
+ */
+G_LOCK_DEFINE_STATIC(da_policy_shared);
+static GHashTable* da_policy_shared = NULL;
+
 /* Expressions */
 
 static inline
@@ -319,13 +347,16 @@ static
 gboolean
 da_policy_expr_identity_match_group(
     int gid,
-    const DACred* cred)
+    const DACred* cred,
+    const DACredPrepared* prepared)
 {
     if (gid == DA_WILDCARD) {
         /* Wild card matches everything */
         return TRUE;
     } else if (gid == DA_INVALID || !cred) {
         return FALSE;
+    } else if (prepared) {
+        return da_cred_prepared_has_group(prepared, gid);
     } else if (gid == cred->egid) {
         return TRUE;
     } else {
@@ -339,6 +370,46 @@ da_policy_expr_identity_match_group(
     }
 }
 
+static
+void
+da_policy_expr_identity_resolve(
+    DAPolicyExprIdentity* x)
+{
+    /*
+     * The names never change, only ids do. Concurrent threads may end
+     * up resolving the same name simultaneously but that's harmless.
+     */
+    const int now = (int)(g_get_monotonic_time() / G_USEC_PER_SEC);
+    const int retry = g_atomic_int_get(&x->retry_time);
+
+    if (!retry || (now - retry) >= 0) {
+        if (g_atomic_int_get(&x->uid) == DA_UNRESOLVED) {
+            const int uid = da_system_uid(x->user);
+            if (uid >= 0) {
+                GDEBUG("%s => %d", x->user, uid);
+                g_atomic_int_set(&x->uid, uid);
+            } else {
+                GDEBUG("Unknown user \"%s\"", x->user);
+            }
+        }
+        if (g_atomic_int_get(&x->gid) == DA_UNRESOLVED) {
+            const int gid = da_system_gid(x->group);
+            if (gid >= 0) {
+                GDEBUG("%s => %d", x->group, gid);
+                g_atomic_int_set(&x->gid, gid);
+            } else {
+                GDEBUG("Unknown group \"%s\"", x->group);
+            }
+        }
+        if (g_atomic_int_get(&x->uid) == DA_UNRESOLVED ||
+            g_atomic_int_get(&x->gid) == DA_UNRESOLVED) {
+            /* Zero means "try right away" hence the | 1 */
+            g_atomic_int_set(&x->retry_time,
+                (now + DA_POLICY_RESOLVE_RETRY_SEC) | 1);
+        }
+    }
+}
+
 static
 gboolean
 da_policy_expr_identity_match(
@@ -346,8 +417,23 @@ da_policy_expr_identity_match(
     const DAPolicyCheck* pc)
 {
     DAPolicyExprIdentity* x = da_policy_expr_identity_cast(expr);
-    return da_policy_expr_identity_match_user(x->uid, pc->cred) &&
-        da_policy_expr_identity_match_group(x->gid, pc->cred);
+    int uid = g_atomic_int_get(&x->uid);
+    int gid = g_atomic_int_get(&x->gid);
+
+    if (uid == DA_UNRESOLVED || gid == DA_UNRESOLVED) {
+        /* Root doesn't get here, it's allowed everything anyway */
+        if (!pc->cred) {
+            return FALSE;
+        }
+        da_policy_expr_identity_resolve(x);
+        uid = g_atomic_int_get(&x->uid);
+        gid = g_atomic_int_get(&x->gid);
+        if (uid == DA_UNRESOLVED || gid == DA_UNRESOLVED) {
+            return FALSE;
+        }
+    }
+    return da_policy_expr_identity_match_user(uid, pc->cred) &&
+        da_policy_expr_identity_match_group(gid, pc->cred, pc->prepared);
 }
 
 static
@@ -356,10 +442,19 @@ da_policy_expr_identity_equal(
     const DAPolicyExpr* expr1,
     const DAPolicyExpr* expr2)
 {
-    /* Types have been compared by the caller */
+    /*
+     * Types have been compared by the caller. Lazily resolved names are
+     * compared as strings (whether or not they have been resolved by now)
+     * and the other ids as numbers. Nothing gets resolved here, so that
+     * the result doesn't depend on the state of the name service.
+     */
     DAPolicyExprIdentity* x1 = da_policy_expr_identity_cast(expr1);
     DAPolicyExprIdentity* x2 = da_policy_expr_identity_cast(expr2);
-    return x1->uid == x2->uid && x1->gid == x2->gid;
+
+    return ((x1->user || x2->user) ? !g_strcmp0(x1->user, x2->user) :
+        (g_atomic_int_get(&x1->uid) == g_atomic_int_get(&x2->uid))) &&
+        ((x1->group || x2->group) ? !g_strcmp0(x1->group, x2->group) :
+        (g_atomic_int_get(&x1->gid) == g_atomic_int_get(&x2->gid)));
 }
 
 static
@@ -368,6 +463,8 @@ da_policy_expr_identity_free(
     DAPolicyExpr* expr)
 {
     DAPolicyExprIdentity* x = da_policy_expr_identity_cast(expr);
+    g_free(x->user);
+    g_free(x->group);
     g_slice_free(DAPolicyExprIdentity, x);
 }
 
@@ -375,7 +472,9 @@ static
 DAPolicyExpr*
 da_policy_expr_identity_new(
     int uid,
-    int gid)
+    int gid,
+    const char* user,
+    const char* group)
 {
     static const DAPolicyExprType expr_type_identity = {
         da_policy_expr_identity_match,
@@ -386,6 +485,12 @@ da_policy_expr_identity_new(
     x->expr.type = &expr_type_identity;
     x->uid = uid;
     x->gid = gid;
+    if (uid == DA_UNRESOLVED) {
+        x->user = g_strdup(user);
+    }
+    if (gid == DA_UNRESOLVED) {
+        x->group = g_strdup(group);
+    }
     return &x->expr;
 }
 
@@ -483,7 +588,9 @@ da_policy_expr_new(
         case DA_PARSER_EXPR_IDENTITY:
             return da_policy_expr_identity_new(
                 expr->data.identity.uid,
-                expr->data.identity.gid);
+                expr->data.identity.gid,
+                expr->data.identity.user,
+                expr->data.identity.group);
         case DA_PARSER_EXPR_CUSTOM:
             return da_policy_expr_custom_new(
                 expr->data.custom.action,
@@ -505,45 +612,175 @@ da_policy_expr_new(
 }
 
 static
-void
-da_policy_add_entry(
-    DAPolicy* policy,
+guint32
+da_policy_expr_cred_fields(
+    const DAParserExpr* expr)
+{
+    if (expr) {
+        switch (expr->type) {
+        case DA_PARSER_EXPR_IDENTITY:
+            /* Any real group requires the supplementary groups */
+            return (expr->data.identity.gid == DA_WILDCARD ||
+                expr->data.identity.gid == DA_INVALID) ? 0 :
+                DBUSACCESS_CRED_GROUPS;
+        case DA_PARSER_EXPR_CUSTOM:
+            break;
+        case DA_PARSER_EXPR_NOT:
+            return da_policy_expr_cred_fields(expr->data.expr[0]);
+        case DA_PARSER_EXPR_AND:
+        case DA_PARSER_EXPR_OR:
+            return da_policy_expr_cred_fields(expr->data.expr[0]) |
+                da_policy_expr_cred_fields(expr->data.expr[1]);
+        }
+    }
+    return 0;
+}
+
+static
+DAPolicyEntry*
+da_policy_entry_new(
     const DAParserEntry* parser_entry)
 {
     DAPolicyEntry* entry = g_slice_new0(DAPolicyEntry);
-    DAPolicyEntry* last = policy->entries;
     entry->access = parser_entry->access;
     entry->expr =  da_policy_expr_new(parser_entry->expr);
-    if (last) {
-        while (last->next) {
-            last = last->next;
-        }
-        last->next = entry;
-    } else {
-        policy->entries = entry;
+    return entry;
+}
+
+static
+DAPolicy*
+da_policy_new_from_result(
+    DAParser* parser)
+{
+    DAPolicy* policy = g_slice_new0(DAPolicy);
+    DAPolicyEntry** tail = &policy->entries;
+    GSList* entry = da_parser_get_result(parser);
+    while (entry) {
+        const DAParserEntry* parser_entry = entry->data;
+
+        policy->cred_fields |= da_policy_expr_cred_fields(parser_entry->expr);
+        *tail = da_policy_entry_new(parser_entry);
+        tail = &(*tail)->next;
+        entry = entry->next;
     }
+    policy->ref_count = 1;
+    return policy;
 }
 
+static
 DAPolicy*
-da_policy_new_full(
-    const char* spec,
-    const DA_ACTION* actions)
+da_policy_new_from_parser(
+    DAParser* parser)
 {
-    DAParser* parser = da_parser_compile(spec, actions);
     if (parser) {
-        DAPolicy* policy = g_slice_new0(DAPolicy);
-        GSList* entry = da_parser_get_result(parser);
-        while (entry) {
-            da_policy_add_entry(policy, entry->data);
-            entry = entry->next;
-        }
-        policy->ref_count = 1;
+        DAPolicy* policy = da_policy_new_from_result(parser);
         da_parser_delete(parser);
         return policy;
     }
     return NULL;
 }
 
+static
+DAPolicy*
+da_policy_new_cached(
+    const char* spec,
+    const DA_ACTION* actions,
+    DAActionTable* table,
+    DA_POLICY_FLAGS flags)
+{
+    DAPolicy* policy = NULL;
+    if (spec) {
+        const gsize len = strlen(spec);
+        char* path = da_cache_path(spec, len, table ?
+            da_action_table_actions(table) : actions, flags);
+        DAParser* parser = path ? da_cache_load(path, flags) : NULL;
+
+        if (parser) {
+            policy = da_policy_new_from_result(parser);
+        } else {
+            parser = da_parser_new(actions, table, flags);
+            if (da_parser_parse_buffer(parser, spec, len)) {
+                policy = da_policy_new_from_result(parser);
+                /*
+                 * Failed lookups may succeed later (e.g. once the name
+                 * service is up), don't let them outlive this process.
+                 */
+                if (path && !da_parser_has_unresolved_names(parser)) {
+                    da_cache_store(path, parser);
+                }
+            }
+        }
+        da_parser_delete(parser);
+        g_free(path);
+    }
+    return policy;
+}
+
+DAPolicy*
+da_policy_new_with_flags(
+    const char* spec,
+    const DA_ACTION* actions,
+    DA_POLICY_FLAGS flags)
+{
+    return da_policy_new_cached(spec, actions, NULL, flags);
+}
+
+DAPolicy*
+da_policy_new_with_table(
+    const char* spec,
+    DAActionTable* table,
+    DA_POLICY_FLAGS flags)
+{
+    return da_policy_new_cached(spec, NULL, table, flags);
+}
+
+DAPolicy*
+da_policy_new_from_buffer(
+    const void* data,
+    gsize len,
+    const DA_ACTION* actions)
+{
+    return da_policy_new_from_parser(da_parser_compile_buffer(data, len,
+        actions, DA_POLICY_FLAGS_NONE));
+}
+
+DAPolicy*
+da_policy_new_from_file(
+    const char* path,
+    const DA_ACTION* actions)
+{
+    DAPolicy* policy = NULL;
+    if (path) {
+        GError* error = NULL;
+        GMappedFile* map = g_mapped_file_new(path, FALSE, &error);
+        if (map) {
+            /* The mapping is scanned in place */
+            policy = da_policy_new_from_buffer(g_mapped_file_get_contents(map),
+                g_mapped_file_get_length(map), actions);
+            g_mapped_file_unref(map);
+        } else {
+            GWARN("%s", GERRMSG(error));
+            g_error_free(error);
+        }
+    }
+    return policy;
+}
+
+void
+da_policy_set_cache_dir(
+    const char* dir)
+{
+    da_cache_set_dir(dir);
+}
+
+DAPolicy*
+da_policy_new_full(
+    const char* spec,
+    const DA_ACTION* actions)
+{
+    return da_policy_new_with_flags(spec, actions, DA_POLICY_FLAGS_NONE);
+}
+
 DAPolicy*
 da_policy_new(
     const char* spec)
@@ -576,18 +813,240 @@ da_policy_ref(
     return policy;
 }
 
+static
+gboolean
+da_policy_unref_shared(
+    DAPolicy* policy)
+{
+    return da_weak_table_unref(&policy->ref_count,
+        &G_LOCK_NAME(da_policy_shared), &da_policy_shared, policy->shared_key);
+}
+
 void
 da_policy_unref(
     DAPolicy* policy)
 {
     if (policy) {
-        if (g_atomic_int_dec_and_test(&policy->ref_count)) {
+        if (policy->shared_key ? da_policy_unref_shared(policy) :
+            g_atomic_int_dec_and_test(&policy->ref_count)) {
             da_policy_finalize(policy);
+            g_free(policy->shared_key);
             g_slice_free(DAPolicy, policy);
         }
     }
 }
 
+static
+char*
+da_policy_shared_key(
+    const char* spec,
+    const DA_ACTION* actions)
+{
+    /* Length prefixes make the key unambiguous */
+    GString* key = g_string_new(NULL);
+
+    g_string_append_printf(key, "%u:%s", (guint)strlen(spec), spec);
+    if (actions) {
+        const DA_ACTION* action;
+
+        for (action = actions; action->name; action++) {
+            g_string_append_printf(key, ";%u,%u,%u:%s", action->id,
+                action->args, (guint)strlen(action->name), action->name);
+        }
+    }
+    return g_string_free(key, FALSE);
+}
+
+static
+DAPolicy*
+da_policy_shared_lookup(
+    const char* key)
+{
+    /* Caller holds the lock */
+    DAPolicy* policy = da_policy_shared ?
+        g_hash_table_lookup(da_policy_shared, key) : NULL;
+
+    if (policy) {
+        g_atomic_int_inc(&policy->ref_count);
+    }
+    return policy;
+}
+
+DAPolicy*
+da_policy_new_shared(
+    const char* spec,
+    const DA_ACTION* actions)
+{
+    DAPolicy* policy = NULL;
+
+    if (spec) {
+        char* key = da_policy_shared_key(spec, actions);
+
+        G_LOCK(da_policy_shared);
+        policy = da_policy_shared_lookup(key);
+        G_UNLOCK(da_policy_shared);
+
+        if (policy) {
+            g_free(key);
+        } else {
+            /* Compile without holding the lock */
+            DAPolicy* compiled = da_policy_new_full(spec, actions);
+
+            if (compiled) {
+                G_LOCK(da_policy_shared);
+                policy = da_policy_shared_lookup(key);
+                if (!policy) {
+                    if (!da_policy_shared) {
+                        da_policy_shared = g_hash_table_new(g_str_hash,
+                            g_str_equal);
+                    }
+                    policy = compiled;
+                    policy->shared_key = key;
+                    g_hash_table_insert(da_policy_shared, key, policy);
+                    compiled = NULL;
+                    key = NULL;
+                }
+                G_UNLOCK(da_policy_shared);
+
+                /* Someone else has compiled it in the meantime */
+                da_policy_unref(compiled);
+            }
+            g_free(key);
+        }
+    }
+    return policy;
+}
+
+DAPolicyCompiler*
+da_policy_compiler_new_with_table(
+    DAActionTable* table,
+    DA_POLICY_FLAGS flags)
+{
+    DAPolicyCompiler* compiler = g_slice_new0(DAPolicyCompiler);
+    compiler->parser = da_parser_new(NULL, table, flags);
+    compiler->ref_count = 1;
+    return compiler;
+}
+
+DAPolicyCompiler*
+da_policy_compiler_new(
+    const DA_ACTION* actions,
+    DA_POLICY_FLAGS flags)
+{
+    /* Same semantics as da_policy_new_full, hence no validation */
+    DAActionTable* table = da_action_table_new_lenient(actions);
+    DAPolicyCompiler* compiler = da_policy_compiler_new_with_table(table,
+        flags);
+    da_action_table_unref(table);
+    return compiler;
+}
+
+DAPolicyCompiler*
+da_policy_compiler_ref(
+    DAPolicyCompiler* compiler)
+{
+    if (compiler) {
+        g_atomic_int_inc(&compiler->ref_count);
+    }
+    return compiler;
+}
+
+void
+da_policy_compiler_unref(
+    DAPolicyCompiler* compiler)
+{
+    if (compiler) {
+        if (g_atomic_int_dec_and_test(&compiler->ref_count)) {
+            da_parser_delete(compiler->parser);
+            g_slice_free(DAPolicyCompiler, compiler);
+        }
+    }
+}
+
+DAPolicy*
+da_policy_compiler_compile_buffer(
+    DAPolicyCompiler* compiler,
+    const void* data,
+    gsize len)
+{
+    return (compiler && (data || !len) &&
+        da_parser_parse_buffer(compiler->parser, data, len)) ?
+        da_policy_new_from_result(compiler->parser) : NULL;
+}
+
+DAPolicy*
+da_policy_compiler_compile(
+    DAPolicyCompiler* compiler,
+    const char* spec)
+{
+    return spec ? da_policy_compiler_compile_buffer(compiler, spec,
+        strlen(spec)) : NULL;
+}
+
+typedef struct da_policy_compile_all {
+    const char* const* specs;
+    DAPolicy** policies;
+    DAActionTable* table;
+    DA_POLICY_FLAGS flags;
+} DAPolicyCompileAll;
+
+static
+gpointer
+da_policy_compile_all_start(
+    gpointer data)
+{
+    DAPolicyCompileAll* all = data;
+
+    /* Each thread has its own parser */
+    return da_parser_new(NULL, all->table, all->flags);
+}
+
+static
+gboolean
+da_policy_compile_all_one(
+    guint i,
+    gpointer parser,
+    gpointer data)
+{
+    DAPolicyCompileAll* all = data;
+    const char* spec = all->specs[i];
+
+    all->policies[i] = (spec && da_parser_parse_buffer(parser, spec,
+        strlen(spec))) ? da_policy_new_from_result(parser) : NULL;
+    return all->policies[i] != NULL;
+}
+
+static
+void
+da_policy_compile_all_finish(
+    gpointer parser)
+{
+    da_parser_delete(parser);
+}
+
+guint
+da_policy_compile_all(
+    const char* const* specs,
+    guint count,
+    DAActionTable* table,
+    DA_POLICY_FLAGS flags,
+    guint max_threads,
+    DAPolicy** policies)
+{
+    if (specs && policies && count) {
+        DAPolicyCompileAll all;
+
+        all.specs = specs;
+        all.policies = policies;
+        all.table = table;
+        all.flags = flags;
+        return da_parallel_for(count, max_threads,
+            da_policy_compile_all_start, da_policy_compile_all_one,
+            da_policy_compile_all_finish, &all);
+    }
+    return 0;
+}
+
 gboolean
 da_policy_equal(
     const DAPolicy* p1,
@@ -612,26 +1071,28 @@ da_policy_equal(
     }
 }
 
+guint32
+da_policy_cred_fields(
+    const DAPolicy* policy)
+{
+    return policy ? policy->cred_fields : 0;
+}
+
+static
 DA_ACCESS
-da_policy_check(
+da_policy_check_internal(
     const DAPolicy* policy,
-    const DACred* cred,
-    guint action,
-    const char* arg,
+    const DAPolicyCheck* check,
     DA_ACCESS def)
 {
     DA_ACCESS result = def;
-    if (cred && !cred->euid) {
+    if (check->cred && !check->cred->euid) {
         /* No checks for root user */
         result = DA_ACCESS_ALLOW;
     } else if (policy) {
         DAPolicyEntry* entry = policy->entries;
-        DAPolicyCheck check;
-        check.cred = cred;
-        check.action = action;
-        check.arg = arg;
         while (entry) {
-            if (da_policy_expr_match(entry->expr, &check)) {
+            if (da_policy_expr_match(entry->expr, check)) {
                 result = entry->access;
             }
             entry = entry->next;
@@ -640,6 +1101,38 @@ da_policy_check(
     return result;
 }
 
+DA_ACCESS
+da_policy_check(
+    const DAPolicy* policy,
+    const DACred* cred,
+    guint action,
+    const char* arg,
+    DA_ACCESS def)
+{
+    DAPolicyCheck check;
+    check.cred = cred;
+    check.prepared = NULL;
+    check.action = action;
+    check.arg = arg;
+    return da_policy_check_internal(policy, &check, def);
+}
+
+DA_ACCESS
+da_policy_check_prepared(
+    const DAPolicy* policy,
+    const DACredPrepared* prepared,
+    guint action,
+    const char* arg,
+    DA_ACCESS def)
+{
+    DAPolicyCheck check;
+    check.cred = prepared ? &prepared->cred : NULL;
+    check.prepared = prepared;
+    check.action = action;
+    check.arg = arg;
+    return da_policy_check_internal(policy, &check, def);
+}
+
 /*
  * Local Variables:
  * mode: C
@@ -32,7 +32,6 @@
 
 %{
 #include "dbusaccess_parser_p.h"
-#include "dbusaccess_system.h"
 #include "dbusaccess_log.h"
 #define FORMAT_VERSION 1
 %}
@@ -40,6 +39,7 @@
 %union 
 {
     int number;
+    DAParserId id;
     const char* string;
     DA_ACCESS access;
     DAParserEntry* entry;
@@ -67,8 +67,8 @@
 %token ERROR
 
 %type <number> version
-%type <number> user
-%type <number> group
+%type <id> user
+%type <id> group
 %type <access> access
 %type <list> entries
 %type <entry> entry
@@ -111,11 +111,12 @@ version:
 entries:
     entry
     {
-        $$ = da_parser_new_link(parser, $1);
+        $$ = da_parser_new_link(parser, $1, NULL);
     }
     | entries ';' entry
     {
-        $$ = g_slist_concat($1, da_parser_new_link(parser, $3));
+        /* The list is built in reverse, da_parser_add_entries fixes that */
+        $$ = da_parser_new_link(parser, $3, $1);
     }
 
 entry:
@@ -145,37 +146,33 @@ access:
 user:
     NUMBER
     {
-        $$ = ($1 < 0) ? DA_WILDCARD : $1;
+        $$.id = ($1 < 0) ? DA_WILDCARD : $1;
+        $$.name = NULL;
     }
     | WILDCARD
     {
-        $$ = DA_WILDCARD;
+        $$.id = DA_WILDCARD;
+        $$.name = NULL;
     }
     | WORD
     {
-        $$ = da_system_uid($1);
-        if ($$ < 0) {
-            GDEBUG("Unknown user \"%s\"", $1);
-            $$ = DA_INVALID;
-        }
+        $$ = da_parser_user(parser, $1);
     }
 
 group:
     NUMBER
     {
-        $$ = ($1 < 0) ? DA_WILDCARD : $1;
+        $$.id = ($1 < 0) ? DA_WILDCARD : $1;
+        $$.name = NULL;
     }
     | WILDCARD
     {
-        $$ = DA_WILDCARD;
+        $$.id = DA_WILDCARD;
+        $$.name = NULL;
     }
     | WORD
     {
-        $$ = da_system_gid($1);
-        if ($$ < 0) {
-            GDEBUG("Unknown group \"%s\"", $1);
-            $$ = DA_INVALID;
-        }
+        $$ = da_parser_group(parser, $1);
     }
 
 expr:
@@ -200,15 +197,15 @@ expr:
 term:
     USER '(' user ')'
     {
-        $$ = da_parser_new_expr_identity(parser, $3, DA_WILDCARD);
+        $$ = da_parser_new_expr_identity(parser, &$3, NULL);
     }
     | USER '(' user ':' group ')'
     {
-        $$ = da_parser_new_expr_identity(parser, $3, $5);
+        $$ = da_parser_new_expr_identity(parser, &$3, &$5);
     }
     | GROUP '(' group ')'
     {
-        $$ = da_parser_new_expr_identity(parser, DA_WILDCARD, $3);
+        $$ = da_parser_new_expr_identity(parser, NULL, &$3);
     }
     | ID '(' ')'
     {
@@ -30,60 +30,431 @@
  * THE POSSIBILITY OF SUCH DAMAGE.
  */
 
-#include "dbusaccess_proc.h"
-#include "dbusaccess_cred_p.h"
+#define _GNU_SOURCE /* struct ucred */
+
+#include "dbusaccess_proc_p.h"
+#include "dbusaccess_parallel.h"
+#include "dbusaccess_procfs.h"
 #include "dbusaccess_log.h"
 
 #include <gutil_macros.h>
 
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+
+#ifndef SO_PEERGROUPS
+#  define SO_PEERGROUPS 59 /* Since Linux 4.13 */
+#endif
+
+#ifndef SO_PEERPIDFD
+#  define SO_PEERPIDFD 77 /* Since Linux 6.5 */
+#endif
+
+#ifndef SYS_pidfd_open
+#  define SYS_pidfd_open 434 /* Since Linux 5.3 */
+#endif
+
 typedef struct da_proc_priv {
     DAProc pub;
-    DACredPriv cred;
+    DACredPrepared* prepared; /* Interned, owns pub.cred.groups */
+    int pidfd;
     gint ref_count;
 } DAProcPriv;
 
+typedef struct da_proc_exit_watch {
+    DAProc* proc;
+    DAProcFunc fn;
+    void* user_data;
+} DAProcExitWatch;
+
 static inline DAProcPriv* da_proc_cast(DAProc* proc)
     { return G_CAST(proc, DAProcPriv, pub); }
 
+static
+DAProcPriv*
+da_proc_alloc(
+    void)
+{
+    DAProcPriv* priv = g_slice_new0(DAProcPriv);
+
+    priv->pidfd = -1;
+    priv->ref_count = 1;
+    return priv;
+}
+
+static
+void
+da_proc_free(
+    DAProcPriv* priv)
+{
+    da_cred_prepared_unref(priv->prepared);
+    if (priv->pidfd >= 0) {
+        close(priv->pidfd);
+    }
+    g_slice_free(DAProcPriv, priv);
+}
+
+static
+DAProc*
+da_proc_new_interned(
+    pid_t pid,
+    const DACred* cred)
+{
+    /* Processes with identical credentials share one copy of them */
+    DAProcPriv* priv = da_proc_alloc();
+    DAProc* proc = &priv->pub;
+
+    priv->prepared = da_cred_prepared_intern(cred);
+    proc->pid = pid;
+    proc->cred = priv->prepared->cred;
+    return proc;
+}
+
 DAProc*
 da_proc_new(
     pid_t pid)
+{
+    return da_proc_new_full(pid, DBUSACCESS_CRED_ALL);
+}
+
+DAProc*
+da_proc_new_full(
+    pid_t pid,
+    guint32 fields)
 {
     DAProc* proc = NULL;
 
     if (pid) {
-        char* fname = g_strdup_printf("/proc/%u/status", (guint)pid);
-        GError* error = NULL;
-        gchar* data = NULL;
-        gsize len = 0;
-
-        if (g_file_get_contents(fname, &data, &len, &error)) {
-            DAProcPriv* priv = g_slice_new0(DAProcPriv);
-
-            priv->ref_count = 1;
-            GDEBUG("Parsing %s", fname);
-            if (da_cred_parse(&priv->pub.cred, &priv->cred, data, len)) {
-                proc = &priv->pub;
-                proc->pid = pid;
+        DACred cred;
+        DACredPriv cred_priv;
+
+        memset(&cred, 0, sizeof(cred));
+        memset(&cred_priv, 0, sizeof(cred_priv));
+        if (da_procfs_read_cred(pid, &cred, &cred_priv, fields)) {
+            proc = da_proc_new_interned(pid, &cred);
+        }
+        da_cred_priv_cleanup(&cred_priv);
+    }
+    return proc;
+}
+
+DAProc*
+da_proc_new_from_cred(
+    pid_t pid,
+    const DACred* cred)
+{
+    return da_proc_new_interned(pid, cred);
+}
+
+DAProc*
+da_proc_new_pidfd(
+    pid_t pid,
+    guint32 fields)
+{
+    if (pid > 0) {
+        /* Pin the process before reading its credentials */
+        const int pidfd = syscall(SYS_pidfd_open, pid, 0);
+
+        if (pidfd >= 0) {
+            DAProc* proc = da_proc_new_full(pid, fields);
+
+            if (proc) {
+                DAProcPriv* priv = da_proc_cast(proc);
+
+                priv->pidfd = pidfd;
+                if (da_proc_alive(proc)) {
+                    return proc;
+                }
+                /* The pid may have been reused while we were reading */
+                GDEBUG("Process %u has exited", (guint)pid);
+                da_proc_unref(proc);
             } else {
-                g_slice_free(DAProcPriv, priv);
+                close(pidfd);
             }
-            g_free(data);
+        } else if (errno == ENOSYS) {
+            /* Old kernel, exit can't be watched */
+            GDEBUG("pidfd_open: %s", strerror(errno));
+            return da_proc_new_full(pid, fields);
         } else {
-            GDEBUG("%s: %s", fname, GERRMSG(error));
-            g_error_free(error);
+            GDEBUG("pidfd_open(%u): %s", (guint)pid, strerror(errno));
         }
-        g_free(fname);
     }
-    return proc;
+    return NULL;
 }
 
+typedef struct da_proc_new_all {
+    const pid_t* pids;
+    DAProc** procs;
+    guint32 fields;
+} DAProcNewAll;
+
 static
+gboolean
+da_proc_new_all_one(
+    guint i,
+    gpointer state,
+    gpointer data)
+{
+    DAProcNewAll* all = data;
+
+    all->procs[i] = da_proc_new_full(all->pids[i], all->fields);
+    return all->procs[i] != NULL;
+}
+
+guint
+da_proc_new_all(
+    const pid_t* pids,
+    guint count,
+    guint32 fields,
+    guint max_threads,
+    DAProc** procs)
+{
+    if (pids && procs && count) {
+        DAProcNewAll all;
+
+        /*
+         * The reads are spread over a thread pool. Batching them with
+         * io_uring wouldn't make them asynchronous: procfs files are
+         * generated by the kernel on read and io_uring punts such reads
+         * to its own worker threads anyway.
+         */
+        all.pids = pids;
+        all.procs = procs;
+        all.fields = fields;
+        return da_parallel_for(count, max_threads, NULL,
+            da_proc_new_all_one, NULL, &all);
+    }
+    return 0;
+}
+
+DAProc**
+da_proc_snapshot(
+    guint32 fields,
+    guint max_threads,
+    guint* count)
+{
+    GError* error = NULL;
+    GDir* dir = g_dir_open("/proc", 0, &error);
+    DAProc** procs = NULL;
+    guint n = 0;
+
+    if (dir) {
+        GArray* pids = g_array_new(FALSE, FALSE, sizeof(pid_t));
+        const char* name;
+
+        while ((name = g_dir_read_name(dir)) != NULL) {
+            /* Only numeric entries are processes */
+            const char* ptr = name;
+            guint64 pid = 0;
+
+            while (g_ascii_isdigit(*ptr) && pid <= G_MAXINT) {
+                pid = pid * 10 + (*ptr++ - '0');
+            }
+            if (!*ptr && ptr != name && pid > 0 && pid <= G_MAXINT) {
+                const pid_t p = (pid_t)pid;
+                g_array_append_val(pids, p);
+            }
+        }
+        g_dir_close(dir);
+
+        if (pids->len) {
+            guint i;
+
+            procs = g_new(DAProc*, pids->len);
+            da_proc_new_all((pid_t*)pids->data, pids->len, fields,
+                max_threads, procs);
+
+            /* Drop the processes which have exited in the meantime */
+            for (i = 0; i < pids->len; i++) {
+                if (procs[i]) {
+                    procs[n++] = procs[i];
+                }
+            }
+            if (!n) {
+                g_free(procs);
+                procs = NULL;
+            }
+        }
+        g_array_free(pids, TRUE);
+    } else {
+        GWARN("%s", GERRMSG(error));
+        g_error_free(error);
+    }
+    if (count) {
+        *count = n;
+    }
+    return procs;
+}
+
 void
-da_proc_finalize(
-    DAProcPriv* priv)
+da_proc_list_free(
+    DAProc** procs,
+    guint count)
+{
+    if (procs) {
+        guint i;
+
+        for (i = 0; i < count; i++) {
+            da_proc_unref(procs[i]);
+        }
+        g_free(procs);
+    }
+}
+
+static
+gboolean
+da_proc_pidfd_alive(
+    int pidfd)
+{
+    /* pidfd becomes readable when the process exits */
+    struct pollfd pfd;
+    int n;
+
+    memset(&pfd, 0, sizeof(pfd));
+    pfd.fd = pidfd;
+    pfd.events = POLLIN;
+    do {
+        n = poll(&pfd, 1, 0);
+    } while (n < 0 && errno == EINTR);
+    return !n;
+}
+
+/* Returns FALSE if SO_PEERGROUPS is not supported */
+static
+gboolean
+da_proc_socket_groups(
+    int fd,
+    DACred* cred,
+    DACredPriv* priv)
 {
-    da_cred_priv_cleanup(&priv->cred);
+    /* Most group lists fit into the inline storage */
+    gid_t* groups = da_cred_priv_groups(priv, DA_CRED_INLINE_GROUPS);
+    socklen_t len = DA_CRED_INLINE_GROUPS * sizeof(gid_t);
+    int err = getsockopt(fd, SOL_SOCKET, SO_PEERGROUPS, groups, &len);
+
+    if (err < 0 && errno == ERANGE) {
+        /* The required size has been stored in len */
+        groups = da_cred_priv_groups(priv, len / sizeof(gid_t));
+        err = getsockopt(fd, SOL_SOCKET, SO_PEERGROUPS, groups, &len);
+    }
+    if (!err) {
+        const guint n = len / sizeof(gid_t);
+
+        if (n > 0) {
+            cred->groups = groups;
+            cred->ngroups = n;
+        } else {
+            da_cred_priv_cleanup(priv);
+        }
+        cred->flags |= DBUSACCESS_CRED_GROUPS;
+    } else {
+        GDEBUG("SO_PEERGROUPS: %s", strerror(errno));
+        da_cred_priv_cleanup(priv);
+    }
+    return !err;
+}
+
+static
+int
+da_proc_socket_pidfd(
+    int fd,
+    pid_t pid)
+{
+    /*
+     * SO_PEERPIDFD refers to the peer itself, pidfd_open may already
+     * pick up another process which has reused the pid.
+     */
+    int pidfd = -1;
+    socklen_t len = sizeof(pidfd);
+
+    if (getsockopt(fd, SOL_SOCKET, SO_PEERPIDFD, &pidfd, &len) < 0) {
+        GDEBUG("SO_PEERPIDFD: %s", strerror(errno));
+        pidfd = syscall(SYS_pidfd_open, pid, 0);
+        if (pidfd < 0) {
+            GDEBUG("pidfd_open(%u): %s", (guint)pid, strerror(errno));
+        }
+    }
+    return pidfd;
+}
+
+DAProc*
+da_proc_new_from_peer(
+    int fd,
+    pid_t pid,
+    uid_t uid,
+    gid_t gid,
+    guint32 fields)
+{
+    DAProc* proc;
+    DACred cred;
+    DACredPriv cred_priv;
+    guint32 proc_fields = fields & DBUSACCESS_CRED_CAPS;
+
+    memset(&cred, 0, sizeof(cred));
+    memset(&cred_priv, 0, sizeof(cred_priv));
+    cred.euid = uid;
+    cred.egid = gid;
+    if ((fields & DBUSACCESS_CRED_GROUPS) &&
+        !da_proc_socket_groups(fd, &cred, &cred_priv)) {
+        /* Old kernel, have to get the groups from /proc */
+        proc_fields |= DBUSACCESS_CRED_GROUPS;
+    }
+
+    /* Capabilities are only available from /proc */
+    if (proc_fields && pid > 0) {
+        /* Pin the process, the pid may get reused while we are reading */
+        const int pidfd = da_proc_socket_pidfd(fd, pid);
+        DACred tmp;
+
+        memset(&tmp, 0, sizeof(tmp));
+        if (da_procfs_read_cred(pid, &tmp, &cred_priv, proc_fields)) {
+            if (tmp.euid != uid || tmp.egid != gid) {
+                /* Not the peer (anymore), don't mix up the credentials */
+                GDEBUG("Process %u is not the peer of socket %d",
+                    (guint)pid, fd);
+            } else if (pidfd >= 0 && !da_proc_pidfd_alive(pidfd)) {
+                GDEBUG("Process %u has exited", (guint)pid);
+            } else {
+                cred.flags |= tmp.flags;
+                cred.caps = tmp.caps;
+                if (tmp.flags & DBUSACCESS_CRED_GROUPS) {
+                    cred.groups = tmp.groups;
+                    cred.ngroups = tmp.ngroups;
+                }
+            }
+        }
+        if (pidfd >= 0) {
+            close(pidfd);
+        }
+    }
+    proc = da_proc_new_interned(pid, &cred);
+    da_cred_priv_cleanup(&cred_priv);
+    GDEBUG("Socket %d peer pid %u uid %u gid %u", fd, (guint)pid,
+        (guint)uid, (guint)gid);
+    return proc;
+}
+
+DAProc*
+da_proc_new_from_socket(
+    int fd,
+    guint32 fields)
+{
+    struct ucred ucred;
+    socklen_t len = sizeof(ucred);
+
+    memset(&ucred, 0, sizeof(ucred));
+    if (fd >= 0 && !getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &ucred, &len)) {
+        return da_proc_new_from_peer(fd, ucred.pid, ucred.uid, ucred.gid,
+            fields);
+    } else if (fd >= 0) {
+        GDEBUG("SO_PEERCRED: %s", strerror(errno));
+    }
+    return NULL;
 }
 
 DAProc*
@@ -104,12 +475,112 @@ da_proc_unref(
     if (proc) {
         DAProcPriv* priv = da_proc_cast(proc);
         if (g_atomic_int_dec_and_test(&priv->ref_count)) {
-            da_proc_finalize(priv);
-            g_slice_free(DAProcPriv, priv);
+            da_proc_free(priv);
         }
     }
 }
 
+int
+da_proc_pidfd(
+    DAProc* proc)
+{
+    return proc ? da_proc_cast(proc)->pidfd : -1;
+}
+
+gboolean
+da_proc_alive(
+    DAProc* proc)
+{
+    if (proc) {
+        DAProcPriv* priv = da_proc_cast(proc);
+
+        if (priv->pidfd >= 0) {
+            return da_proc_pidfd_alive(priv->pidfd);
+        } else if (proc->pid > 0) {
+            /* Can't tell if the pid has been reused */
+            return !kill(proc->pid, 0) || errno == EPERM;
+        }
+    }
+    return FALSE;
+}
+
+static
+gboolean
+da_proc_exit_watch_cb(
+    GIOChannel* channel,
+    GIOCondition condition,
+    gpointer data)
+{
+    DAProcExitWatch* watch = data;
+
+    GDEBUG("Process %u has exited", (guint)watch->proc->pid);
+    watch->fn(watch->proc, watch->user_data);
+    return G_SOURCE_REMOVE;
+}
+
+static
+void
+da_proc_exit_watch_free(
+    gpointer data)
+{
+    DAProcExitWatch* watch = data;
+
+    da_proc_unref(watch->proc);
+    g_slice_free(DAProcExitWatch, watch);
+}
+
+guint
+da_proc_add_exit_handler(
+    DAProc* proc,
+    DAProcFunc fn,
+    void* user_data)
+{
+    if (proc && fn) {
+        DAProcPriv* priv = da_proc_cast(proc);
+
+        if (priv->pidfd >= 0) {
+            GIOChannel* channel = g_io_channel_unix_new(priv->pidfd);
+            GSource* source = g_io_create_watch(channel,
+                G_IO_IN | G_IO_ERR | G_IO_HUP | G_IO_NVAL);
+            DAProcExitWatch* watch = g_slice_new(DAProcExitWatch);
+            guint id;
+
+            watch->proc = da_proc_ref(proc);
+            watch->fn = fn;
+            watch->user_data = user_data;
+            g_source_set_callback(source, (GSourceFunc)
+                da_proc_exit_watch_cb, watch, da_proc_exit_watch_free);
+            id = g_source_attach(source, g_main_context_get_thread_default());
+            g_source_unref(source);
+            g_io_channel_unref(channel);
+            return id;
+        }
+    }
+    return 0;
+}
+
+void
+da_proc_remove_exit_handler(
+    DAProc* proc,
+    guint id)
+{
+    if (proc && id) {
+        GMainContext* context = g_main_context_get_thread_default();
+        GSource* source = g_main_context_find_source_by_id(context, id);
+
+        if (source) {
+            g_source_destroy(source);
+        }
+    }
+}
+
+const DACredPrepared*
+da_proc_prepared_cred(
+    DAProc* proc)
+{
+    return proc ? da_proc_cast(proc)->prepared : NULL;
+}
+
 /*
  * Local Variables:
  * mode: C
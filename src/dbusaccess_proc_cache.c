@@ -0,0 +1,327 @@
+/*
+ * Copyright (C) 2026 Jolla Ltd.
+ *
+ * You may use this file under the terms of BSD license as follows:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *   3. Neither the names of the copyright holders nor the names of its
+ *      contributors may be used to endorse or promote products derived
+ *      from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "dbusaccess_proc.h"
+#include "dbusaccess_procfs.h"
+#include "dbusaccess_log.h"
+
+/*
+ * Entries are keyed by pid and hold a pidfd, so that a reused pid never
+ * picks up the credentials of the process which had it before. Checking
+ * whether the process is still alive is enough. Kernels without pidfd
+ * support (older than 5.3) validate the entries by the process start
+ * time from /proc/<pid>/stat instead. Neither check is done under the
+ * lock, lookups of other pids never wait for a file read.
+ */
+
+typedef struct da_proc_cache_entry {
+    GList link;             /* In the LRU queue, data points to the entry */
+    DAProc* proc;
+    guint64 start_time;
+    gint64 expires;         /* Monotonic time, microseconds */
+} DAProcCacheEntry;
+
+struct da_proc_cache {
+    GMutex mutex;
+    GHashTable* entries;    /* pid => DAProcCacheEntry */
+    GQueue lru;             /* Most recently used first */
+    DAProcCacheStats stats;
+    guint max_entries;
+    guint ttl_ms;
+    guint32 fields;
+    gint ref_count;
+};
+
+#define DA_PROC_CACHE_SHARED_MAX_ENTRIES (256)
+#define DA_PROC_CACHE_SHARED_TTL_MS (5000)
+
+static gint da_proc_cache_no_pidfd = FALSE; /* Atomic, set on old kernels */
+
+static
+void
+da_proc_cache_entry_free(
+    gpointer data)
+{
+    DAProcCacheEntry* entry = data;
+
+    da_proc_unref(entry->proc);
+    g_slice_free(DAProcCacheEntry, entry);
+}
+
+/* Must be called under the lock */
+static
+void
+da_proc_cache_drop(
+    DAProcCache* cache,
+    DAProcCacheEntry* entry)
+{
+    g_queue_unlink(&cache->lru, &entry->link);
+    g_hash_table_remove(cache->entries, GINT_TO_POINTER(entry->proc->pid));
+}
+
+DAProcCache*
+da_proc_cache_new(
+    guint max_entries,
+    guint ttl_ms,
+    guint32 fields)
+{
+    DAProcCache* cache = g_slice_new0(DAProcCache);
+
+    g_mutex_init(&cache->mutex);
+    cache->entries = g_hash_table_new_full(g_direct_hash, g_direct_equal,
+        NULL, da_proc_cache_entry_free);
+    cache->max_entries = MAX(max_entries, 1);
+    cache->ttl_ms = ttl_ms;
+    cache->fields = fields;
+    cache->ref_count = 1;
+    return cache;
+}
+
+DAProcCache*
+da_proc_cache_shared(
+    void)
+{
+    static DAProcCache* da_proc_cache_shared_instance = NULL;
+
+    if (g_once_init_enter(&da_proc_cache_shared_instance)) {
+        g_once_init_leave(&da_proc_cache_shared_instance,
+            da_proc_cache_new(DA_PROC_CACHE_SHARED_MAX_ENTRIES,
+                DA_PROC_CACHE_SHARED_TTL_MS, DBUSACCESS_CRED_ALL));
+    }
+    return da_proc_cache_ref(da_proc_cache_shared_instance);
+}
+
+DAProcCache*
+da_proc_cache_ref(
+    DAProcCache* cache)
+{
+    if (cache) {
+        g_atomic_int_inc(&cache->ref_count);
+    }
+    return cache;
+}
+
+void
+da_proc_cache_unref(
+    DAProcCache* cache)
+{
+    if (cache && g_atomic_int_dec_and_test(&cache->ref_count)) {
+        g_hash_table_destroy(cache->entries);
+        g_mutex_clear(&cache->mutex);
+        g_slice_free(DAProcCache, cache);
+    }
+}
+
+void
+da_proc_cache_set_ttl(
+    DAProcCache* cache,
+    guint ttl_ms)
+{
+    if (cache) {
+        /* Applies to the entries added from now on */
+        g_mutex_lock(&cache->mutex);
+        cache->ttl_ms = ttl_ms;
+        g_mutex_unlock(&cache->mutex);
+    }
+}
+
+/* Makes syscalls, must be called without holding the lock */
+static
+gboolean
+da_proc_cache_proc_valid(
+    DAProc* proc,
+    guint64 start_time)
+{
+    if (da_proc_pidfd(proc) >= 0) {
+        return da_proc_alive(proc);
+    } else {
+        guint64 current;
+
+        return da_procfs_start_time(proc->pid, &current) &&
+            current == start_time;
+    }
+}
+
+DAProc*
+da_proc_cache_get(
+    DAProcCache* cache,
+    pid_t pid)
+{
+    if (cache && pid > 0) {
+        gint64 now = g_get_monotonic_time();
+        guint64 start1 = 0;
+        DAProcCacheEntry* entry;
+        DAProc* proc = NULL;
+
+        g_mutex_lock(&cache->mutex);
+        entry = g_hash_table_lookup(cache->entries, GINT_TO_POINTER(pid));
+        if (entry) {
+            if (now < entry->expires) {
+                /* Copy out what's needed to check it without the lock */
+                proc = da_proc_ref(entry->proc);
+                start1 = entry->start_time;
+            } else {
+                GDEBUG("Dropping expired entry for pid %u", (guint)pid);
+                cache->stats.expirations++;
+                da_proc_cache_drop(cache, entry);
+            }
+        }
+        if (!proc) {
+            cache->stats.misses++;
+        }
+        g_mutex_unlock(&cache->mutex);
+
+        if (proc) {
+            const gboolean valid = da_proc_cache_proc_valid(proc, start1);
+
+            g_mutex_lock(&cache->mutex);
+            entry = g_hash_table_lookup(cache->entries, GINT_TO_POINTER(pid));
+            if (valid) {
+                if (entry && entry->proc == proc) {
+                    /* Move it to the head of the LRU queue */
+                    g_queue_unlink(&cache->lru, &entry->link);
+                    g_queue_push_head_link(&cache->lru, &entry->link);
+                }
+                cache->stats.hits++;
+                g_mutex_unlock(&cache->mutex);
+                return proc;
+            }
+            if (entry && entry->proc == proc) {
+                GDEBUG("Dropping stale entry for pid %u", (guint)pid);
+                cache->stats.expirations++;
+                da_proc_cache_drop(cache, entry);
+            }
+            cache->stats.misses++;
+            g_mutex_unlock(&cache->mutex);
+            da_proc_unref(proc);
+        }
+
+        /* Read /proc without holding the lock */
+        if (!g_atomic_int_get(&da_proc_cache_no_pidfd)) {
+            /* This makes sure that the process is still alive */
+            proc = da_proc_new_pidfd(pid, cache->fields);
+            if (!proc) {
+                return NULL;
+            } else if (da_proc_pidfd(proc) < 0) {
+                /* Fall back to the start time from now on */
+                g_atomic_int_set(&da_proc_cache_no_pidfd, TRUE);
+                return proc;
+            }
+        } else {
+            guint64 start2;
+
+            if (!da_procfs_start_time(pid, &start1)) {
+                return NULL;
+            }
+            proc = da_proc_new_full(pid, cache->fields);
+            if (!proc) {
+                return NULL;
+            } else if (!da_procfs_start_time(pid, &start2) ||
+                start1 != start2) {
+                /* The pid has been reused, don't cache this one */
+                return proc;
+            }
+        }
+
+        now = g_get_monotonic_time();
+        g_mutex_lock(&cache->mutex);
+        entry = g_hash_table_lookup(cache->entries, GINT_TO_POINTER(pid));
+        if (entry) {
+            /* Another thread has beaten us to it */
+            da_proc_cache_drop(cache, entry);
+        }
+        entry = g_slice_new0(DAProcCacheEntry);
+        entry->link.data = entry;
+        entry->proc = da_proc_ref(proc);
+        entry->start_time = start1;
+        entry->expires = now + (gint64)cache->ttl_ms * 1000;
+        g_hash_table_insert(cache->entries, GINT_TO_POINTER(pid), entry);
+        g_queue_push_head_link(&cache->lru, &entry->link);
+        while (cache->lru.length > cache->max_entries) {
+            /* Evict the least recently used one */
+            cache->stats.evictions++;
+            da_proc_cache_drop(cache, cache->lru.tail->data);
+        }
+        g_mutex_unlock(&cache->mutex);
+        return proc;
+    }
+    return NULL;
+}
+
+void
+da_proc_cache_remove(
+    DAProcCache* cache,
+    pid_t pid)
+{
+    if (cache) {
+        DAProcCacheEntry* entry;
+
+        g_mutex_lock(&cache->mutex);
+        entry = g_hash_table_lookup(cache->entries, GINT_TO_POINTER(pid));
+        if (entry) {
+            da_proc_cache_drop(cache, entry);
+        }
+        g_mutex_unlock(&cache->mutex);
+    }
+}
+
+void
+da_proc_cache_clear(
+    DAProcCache* cache)
+{
+    if (cache) {
+        g_mutex_lock(&cache->mutex);
+        g_queue_init(&cache->lru);
+        g_hash_table_remove_all(cache->entries);
+        g_mutex_unlock(&cache->mutex);
+    }
+}
+
+void
+da_proc_cache_get_stats(
+    DAProcCache* cache,
+    DAProcCacheStats* stats)
+{
+    if (cache && stats) {
+        g_mutex_lock(&cache->mutex);
+        *stats = cache->stats;
+        stats->size = cache->lru.length;
+        g_mutex_unlock(&cache->mutex);
+    }
+}
+
+/*
+ * Local Variables:
+ * mode: C
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
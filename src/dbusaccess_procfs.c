@@ -0,0 +1,210 @@
+/*
+ * Copyright (C) 2026 Jolla Ltd.
+ *
+ * You may use this file under the terms of BSD license as follows:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *   3. Neither the names of the copyright holders nor the names of its
+ *      contributors may be used to endorse or promote products derived
+ *      from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "dbusaccess_procfs.h"
+#include "dbusaccess_log.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <stdio.h>
+
+#ifndef O_PATH
+#  define O_PATH O_RDONLY
+#endif
+
+/* Large enough for any line of a typical /proc/<pid>/status */
+#define DA_PROCFS_STACK_BUF_SIZE (4096)
+#define DA_PROCFS_CHUNK_SIZE (512)
+
+static int da_procfs_dir_fd = -1;
+
+static
+int
+da_procfs_dir(
+    void)
+{
+    int fd = g_atomic_int_get(&da_procfs_dir_fd);
+
+    if (fd < 0) {
+        fd = open("/proc", O_PATH | O_DIRECTORY | O_CLOEXEC);
+        if (fd >= 0 && !g_atomic_int_compare_and_exchange(&da_procfs_dir_fd,
+            -1, fd)) {
+            /* Another thread has beaten us to it */
+            close(fd);
+            fd = g_atomic_int_get(&da_procfs_dir_fd);
+        }
+    }
+    return fd;
+}
+
+int
+da_procfs_open(
+    pid_t pid,
+    const char* file)
+{
+    const int dir = da_procfs_dir();
+    char path[64];
+    int fd;
+
+    if (dir >= 0) {
+        snprintf(path, sizeof(path), "%u/%s", (guint)pid, file);
+        do {
+            fd = openat(dir, path, O_RDONLY | O_CLOEXEC);
+        } while (fd < 0 && errno == EINTR);
+    } else {
+        snprintf(path, sizeof(path), "/proc/%u/%s", (guint)pid, file);
+        do {
+            fd = open(path, O_RDONLY | O_CLOEXEC);
+        } while (fd < 0 && errno == EINTR);
+    }
+    return fd;
+}
+
+gboolean
+da_procfs_start_time(
+    pid_t pid,
+    guint64* start_time)
+{
+    const int fd = da_procfs_open(pid, "stat");
+    gboolean ok = FALSE;
+
+    if (fd >= 0) {
+        char buf[DA_PROCFS_STACK_BUF_SIZE];
+        gssize len;
+
+        do {
+            len = read(fd, buf, sizeof(buf) - 1);
+        } while (len < 0 && errno == EINTR);
+        if (len > 0) {
+            /* The command name may contain anything, even parentheses */
+            char* ptr;
+
+            buf[len] = 0;
+            ptr = strrchr(buf, ')');
+            if (ptr) {
+                /* The start time is the 22nd field, state is the 3rd */
+                int field = 2;
+
+                while (*ptr && field < 22) {
+                    if (*ptr++ == ' ') {
+                        field++;
+                    }
+                }
+                if (field == 22 && g_ascii_isdigit(*ptr)) {
+                    *start_time = g_ascii_strtoull(ptr, NULL, 10);
+                    ok = TRUE;
+                }
+            }
+        }
+        close(fd);
+    }
+    if (!ok) {
+        GDEBUG("Failed to get /proc/%u/stat start time", (guint)pid);
+    }
+    return ok;
+}
+
+gboolean
+da_procfs_read_cred(
+    pid_t pid,
+    DACred* cred,
+    DACredPriv* priv,
+    guint32 fields)
+{
+    const int fd = da_procfs_open(pid, "status");
+    gboolean ok = FALSE;
+
+    if (fd >= 0) {
+        char stack_buf[DA_PROCFS_STACK_BUF_SIZE];
+        char* buf = stack_buf;
+        gsize size = sizeof(stack_buf);
+        gsize len = 0;
+        DACredParser parser;
+
+        /*
+         * The file is read in small chunks. Uid, Gid and Groups come
+         * early in the file, and there's no need to read past the last
+         * line the caller is interested in.
+         */
+        da_cred_parser_init(&parser, cred, priv, fields);
+        for (;;) {
+            gssize n;
+
+            if (len == size) {
+                /* The line doesn't fit, continue on the heap */
+                if (buf == stack_buf) {
+                    buf = g_malloc(2 * size);
+                    memcpy(buf, stack_buf, len);
+                } else {
+                    buf = g_realloc(buf, 2 * size);
+                }
+                size *= 2;
+            }
+            n = read(fd, buf + len, MIN(size - len, DA_PROCFS_CHUNK_SIZE));
+            if (n > 0) {
+                gsize used;
+
+                len += n;
+                used = da_cred_parser_feed(&parser, buf, len, FALSE);
+                if (da_cred_parser_done(&parser)) {
+                    break;
+                }
+                memmove(buf, buf + used, len - used);
+                len -= used;
+            } else if (!n) {
+                da_cred_parser_feed(&parser, buf, len, TRUE);
+                break;
+            } else if (errno != EINTR) {
+                GDEBUG("/proc/%u/status: %s", (guint)pid, strerror(errno));
+                break;
+            }
+        }
+        ok = da_cred_parser_finish(&parser);
+        GDEBUG("Parsed /proc/%u/status (%s)", (guint)pid, ok ? "ok" : "error");
+        if (buf != stack_buf) {
+            g_free(buf);
+        }
+        close(fd);
+    } else {
+        GDEBUG("/proc/%u/status: %s", (guint)pid, strerror(errno));
+    }
+    return ok;
+}
+
+/*
+ * Local Variables:
+ * mode: C
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
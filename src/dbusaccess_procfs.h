@@ -0,0 +1,80 @@
+/*
+ * Copyright (C) 2026 Jolla Ltd.
+ *
+ * You may use this file under the terms of BSD license as follows:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *   3. Neither the names of the copyright holders nor the names of its
+ *      contributors may be used to endorse or promote products derived
+ *      from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef DBUSACCESS_PROCFS_H
+#define DBUSACCESS_PROCFS_H
+
+#include "dbusaccess_cred_p.h"
+
+/*
+ * Low-level /proc access. Files are opened relative to a cached /proc
+ * directory descriptor and read without going through GIO, so that no
+ * memory is allocated and no GError is created on the fast path.
+ */
+
+/* Returns -1 and sets errno on failure */
+int
+da_procfs_open(
+    pid_t pid,
+    const char* file)
+    G_GNUC_INTERNAL;
+
+/*
+ * Reads the start time (in clock ticks since boot) from /proc/<pid>/stat.
+ * Together with the pid, it uniquely identifies the process.
+ */
+gboolean
+da_procfs_start_time(
+    pid_t pid,
+    guint64* start_time)
+    G_GNUC_INTERNAL;
+
+/*
+ * Reads /proc/<pid>/status and parses the credentials. Fields is
+ * a combination of DBUSACCESS_CRED_* flags for the optional fields.
+ */
+gboolean
+da_procfs_read_cred(
+    pid_t pid,
+    DACred* cred,
+    DACredPriv* priv,
+    guint32 fields)
+    G_GNUC_INTERNAL;
+
+#endif /* DBUSACCESS_PROCFS_H */
+
+/*
+ * Local Variables:
+ * mode: C
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
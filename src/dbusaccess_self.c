@@ -31,65 +31,170 @@
  */
 
 #include "dbusaccess_self.h"
+#include "dbusaccess_cred_p.h"
+#include "dbusaccess_proc_p.h"
 #include "dbusaccess_log.h"
 
 #include <sys/types.h>
-#include <stdlib.h>
+#include <sys/syscall.h>
+#include <linux/capability.h>
 #include <unistd.h>
+#include <errno.h>
+#include <string.h>
 
-static guint self_shared_timeout_id;
-static DASelf* self_shared;
+/*
+ * The shared instance holds a reference. The lock only protects picking
+ * up (or replacing) the pointer and taking a reference, it's never held
+ * while the snapshot is being created or destroyed. Readers holding a
+ * reference to the old snapshot keep it alive after it's replaced.
+ */
+G_LOCK_DEFINE_STATIC(da_self_shared);
+static DASelf* da_self_shared = NULL;   /* Protected by the lock */
+static gint da_self_shared_gen = 0;     /* Atomic */
+
+/* Enough for most processes, larger group lists go to the heap */
+#define DA_SELF_GROUPS_STACK (64)
 
-#define DBUSACCESS_SELF_TIMEOUT_SEC (30)
-#define DBUSACCESS_SELF_TIMEOUT_SEC_ENV "DBUSACCESS_SELF_TIMEOUT_SEC"
+static
+gboolean
+da_self_caps(
+    guint64* caps)
+{
+    struct __user_cap_header_struct header;
+    struct __user_cap_data_struct data[_LINUX_CAPABILITY_U32S_3];
+
+    memset(&header, 0, sizeof(header));
+    memset(data, 0, sizeof(data));
+    header.version = _LINUX_CAPABILITY_VERSION_3;
+    if (!syscall(SYS_capget, &header, data)) {
+        *caps = data[0].effective | ((guint64)data[1].effective << 32);
+        return TRUE;
+    }
+    GDEBUG("capget: %s", strerror(errno));
+    return FALSE;
+}
 
 DASelf*
 da_self_new(
     void)
 {
-    return da_proc_new(getpid());
+    /* Same information as /proc/self/status but without file I/O */
+    gid_t stack_buf[DA_SELF_GROUPS_STACK];
+    gid_t* groups = stack_buf;
+    int n = getgroups(G_N_ELEMENTS(stack_buf), groups);
+    DASelf* self;
+    DACred cred;
+
+    while (n < 0 && errno == EINVAL) {
+        /* Doesn't fit, the number of groups may change in between */
+        n = getgroups(0, NULL);
+        if (n >= 0) {
+            if (groups != stack_buf) {
+                g_free(groups);
+            }
+            groups = g_new(gid_t, MAX(n, 1));
+            n = getgroups(n, groups);
+        }
+    }
+
+    memset(&cred, 0, sizeof(cred));
+    cred.euid = geteuid();
+    cred.egid = getegid();
+    if (n >= 0) {
+        cred.groups = groups;
+        cred.ngroups = n;
+        cred.flags |= DBUSACCESS_CRED_GROUPS;
+    }
+    if (da_self_caps(&cred.caps)) {
+        cred.flags |= DBUSACCESS_CRED_CAPS;
+    }
+    self = da_proc_new_from_cred(getpid(), &cred);
+    if (groups != stack_buf) {
+        g_free(groups);
+    }
+    return self;
 }
 
+/* Cheap check whether the credentials have changed */
 static
 gboolean
-da_self_shared_timeout(
-    gpointer data)
+da_self_current(
+    const DASelf* self)
 {
-    GVERBOSE_("resetting shared instance");
-    GASSERT(self_shared_timeout_id);
-    GASSERT(self_shared == data);
-    self_shared_timeout_id = 0;
-    self_shared = NULL;
-    return G_SOURCE_REMOVE;
+    const DACred* cred = &self->cred;
+
+    if (self->pid != getpid() ||
+        cred->euid != geteuid() ||
+        cred->egid != getegid()) {
+        return FALSE;
+    } else {
+        gid_t groups[DA_SELF_GROUPS_STACK];
+        const int n = getgroups(G_N_ELEMENTS(groups), groups);
+        guint64 caps = 0;
+
+        if (n < 0) {
+            /* Too many to compare on the stack, compare the counts */
+            if (getgroups(0, NULL) != (int)cred->ngroups) {
+                return FALSE;
+            }
+        } else {
+            /* The snapshot holds the normalized (interned) group list */
+            const guint count = da_cred_normalize_groups(groups, n);
+
+            if (count != cred->ngroups || (count > 0 &&
+                memcmp(groups, cred->groups, count * sizeof(groups[0])))) {
+                return FALSE;
+            }
+        }
+        return (!(cred->flags & DBUSACCESS_CRED_CAPS) ||
+            (da_self_caps(&caps) && caps == cred->caps));
+    }
 }
 
+/* Takes ownership of the reference */
 static
 void
-da_self_shared_unref(
-    gpointer data)
+da_self_shared_publish(
+    DASelf* self)
 {
-    da_self_unref(data);
+    DASelf* old;
+
+    G_LOCK(da_self_shared);
+    old = da_self_shared;
+    da_self_shared = self;
+    g_atomic_int_inc(&da_self_shared_gen);
+    G_UNLOCK(da_self_shared);
+    if (old) {
+        da_self_unref(old);
+    }
 }
 
 DASelf*
 da_self_new_shared(
     void)
 {
-    if (!self_shared) {
-        guint sec = DBUSACCESS_SELF_TIMEOUT_SEC;
-        const char* env = getenv(DBUSACCESS_SELF_TIMEOUT_SEC_ENV);
-        if (env) {
-            int interval = atoi(env);
-            if (interval >= 0) {
-                sec = interval;
-            }
+    DASelf* self;
+
+    G_LOCK(da_self_shared);
+    self = da_self_ref(da_self_shared);
+    G_UNLOCK(da_self_shared);
+    if (self) {
+        if (da_self_current(self)) {
+            return self;
         }
-        GASSERT(!self_shared_timeout_id);
-        self_shared = da_self_new();
-        self_shared_timeout_id = g_timeout_add_seconds_full(G_PRIORITY_DEFAULT,
-            sec, da_self_shared_timeout, self_shared, da_self_shared_unref);
+        GDEBUG("Credentials have changed");
+        da_self_unref(self);
     }
-    return da_self_ref(self_shared);
+    self = da_self_new();
+    da_self_shared_publish(da_self_ref(self));
+    return self;
+}
+
+guint
+da_self_shared_generation(
+    void)
+{
+    return (guint)g_atomic_int_get(&da_self_shared_gen);
 }
 
 DASelf*
@@ -110,11 +215,7 @@ void
 da_self_flush(
     void)
 {
-    self_shared = NULL;
-    if (self_shared_timeout_id) {
-        g_source_remove(self_shared_timeout_id);
-        self_shared_timeout_id = 0;
-    }
+    da_self_shared_publish(NULL);
 }
 
 /*
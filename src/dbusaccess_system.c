@@ -30,34 +30,256 @@
  * THE POSSIBILITY OF SUCH DAMAGE.
  */
 
-#include "dbusaccess_system.h"
+#include "dbusaccess_system_p.h"
 #include "dbusaccess_log.h"
 
+#include <sys/stat.h>
+#include <unistd.h>
+#include <errno.h>
 #include <pwd.h>
 #include <grp.h>
+#include <string.h>
 
+/*
+ * Name => id mappings are cached process-wide. The cache is flushed
+ * when the modification time (or size, or inode) of the corresponding
+ * database file changes. Only successful lookups are cached, names
+ * which can't be resolved are looked up again next time (e.g. because
+ * the name service may not be up yet).
+ *
+ * The database files are checked at most once per second, and never
+ * under the lock, so that cache hits don't wait for stat().
+ */
+
+typedef struct da_system_db_stat {
+    gboolean ok;
+    dev_t dev;
+    ino_t ino;
+    off_t size;
+    time_t mtime;
+    long mtime_nsec;
+} DASystemDbStat;
+
+typedef struct da_system_db {
+    const char* path;
+    char* custom_path;
+    DASystemResolveFunc resolve;
+    GHashTable* ids;
+    guint generation;
+    gint64 checked;
+    DASystemDbStat st;
+} DASystemDb;
+
+#define DA_SYSTEM_BUF_SIZE (1024)
+#define DA_SYSTEM_MAX_BUF_SIZE (1024*1024)
+
+static
 int
-da_system_uid(
-    const char* user)
+da_system_resolve_uid(
+    const char* user,
+    char* buf,
+    gsize size)
 {
-    const struct passwd *pw = getpwnam(user);
+    struct passwd pwbuf;
+    struct passwd* pw = NULL;
+    const int err = getpwnam_r(user, &pwbuf, buf, size, &pw);
+
     if (pw) {
         GVERBOSE_("%s => %d", user, (int)pw->pw_uid);
         return pw->pw_uid;
     }
-    return -1;
+    return (err == ERANGE) ? -ERANGE : -1;
 }
 
+static
 int
-da_system_gid(
-    const char* group)
+da_system_resolve_gid(
+    const char* group,
+    char* buf,
+    gsize size)
 {
-    const struct group *gr = getgrnam(group);
+    struct group grbuf;
+    struct group* gr = NULL;
+    const int err = getgrnam_r(group, &grbuf, buf, size, &gr);
+
     if (gr) {
         GVERBOSE_("%s => %d", group, (int)gr->gr_gid);
         return gr->gr_gid;
     }
-    return -1;
+    return (err == ERANGE) ? -ERANGE : -1;
+}
+
+G_LOCK_DEFINE_STATIC(da_system);
+static DASystemDb da_system_passwd = { "/etc/passwd", NULL,
+    da_system_resolve_uid };
+static DASystemDb da_system_group = { "/etc/group", NULL,
+    da_system_resolve_gid };
+static gint64 da_system_check_interval = DA_SYSTEM_CHECK_INTERVAL;
+
+static
+void
+da_system_db_stat(
+    const char* path,
+    DASystemDbStat* dbst)
+{
+    struct stat st;
+
+    memset(dbst, 0, sizeof(*dbst));
+    if (!stat(path, &st)) {
+        dbst->ok = TRUE;
+        dbst->dev = st.st_dev;
+        dbst->ino = st.st_ino;
+        dbst->size = st.st_size;
+        dbst->mtime = st.st_mtim.tv_sec;
+        dbst->mtime_nsec = st.st_mtim.tv_nsec;
+    }
+}
+
+static
+void
+da_system_db_update(
+    DASystemDb* db,
+    const DASystemDbStat* st)
+{
+    /* Caller holds the lock */
+    if (memcmp(&db->st, st, sizeof(*st))) {
+        if (db->ids && g_hash_table_size(db->ids)) {
+            GDEBUG("%s has changed", db->path);
+            g_hash_table_remove_all(db->ids);
+        }
+        db->generation++;
+        db->st = *st;
+    }
+}
+
+static
+int
+da_system_db_lookup(
+    DASystemDb* db,
+    const char* name)
+{
+    const gint64 now = g_get_monotonic_time();
+    gpointer value = NULL;
+    const char* path = NULL;
+    DASystemResolveFunc resolve;
+    gboolean found;
+    guint generation;
+    int id;
+
+    if (!name) {
+        return -1;
+    }
+
+    G_LOCK(da_system);
+    if (!db->checked || (now - db->checked) >= da_system_check_interval) {
+        /* This thread is going to check the file */
+        db->checked = now;
+        path = db->custom_path ? db->custom_path : db->path;
+    }
+    resolve = db->resolve;
+    G_UNLOCK(da_system);
+
+    if (path) {
+        DASystemDbStat st;
+
+        da_system_db_stat(path, &st);
+        G_LOCK(da_system);
+        da_system_db_update(db, &st);
+    } else {
+        G_LOCK(da_system);
+    }
+    found = db->ids && g_hash_table_lookup_extended(db->ids, name,
+        NULL, &value);
+    generation = db->generation;
+    G_UNLOCK(da_system);
+
+    if (found) {
+        id = GPOINTER_TO_INT(value);
+    } else {
+        /* Don't hold the lock while talking to the name service */
+        char stackbuf[DA_SYSTEM_BUF_SIZE];
+        char* buf = stackbuf;
+        gsize size = sizeof(stackbuf);
+
+        while ((id = resolve(name, buf, size)) == -ERANGE &&
+            size < DA_SYSTEM_MAX_BUF_SIZE) {
+            if (buf != stackbuf) {
+                g_free(buf);
+            }
+            size *= 2;
+            buf = g_malloc(size);
+        }
+        if (buf != stackbuf) {
+            g_free(buf);
+        }
+        if (id >= 0) {
+            G_LOCK(da_system);
+            /* Don't cache it if the database has changed in the meantime */
+            if (generation == db->generation) {
+                if (!db->ids) {
+                    db->ids = g_hash_table_new_full(g_str_hash, g_str_equal,
+                        g_free, NULL);
+                }
+                g_hash_table_replace(db->ids, g_strdup(name),
+                    GINT_TO_POINTER(id));
+            }
+            G_UNLOCK(da_system);
+        } else {
+            id = -1;
+        }
+    }
+    return id;
+}
+
+static
+void
+da_system_db_setup(
+    DASystemDb* db,
+    const char* path,
+    DASystemResolveFunc resolve)
+{
+    /* Caller holds the lock */
+    if (db->ids) {
+        g_hash_table_destroy(db->ids);
+        db->ids = NULL;
+    }
+    g_free(db->custom_path);
+    db->custom_path = g_strdup(path);
+    db->resolve = resolve;
+    db->generation++;
+    db->checked = 0;
+    memset(&db->st, 0, sizeof(db->st));
+}
+
+void
+da_system_setup(
+    const char* passwd,
+    const char* group,
+    DASystemResolveFunc resolve_uid,
+    DASystemResolveFunc resolve_gid,
+    gint64 check_interval)
+{
+    G_LOCK(da_system);
+    da_system_db_setup(&da_system_passwd, passwd, resolve_uid ?
+        resolve_uid : da_system_resolve_uid);
+    da_system_db_setup(&da_system_group, group, resolve_gid ?
+        resolve_gid : da_system_resolve_gid);
+    da_system_check_interval = check_interval;
+    G_UNLOCK(da_system);
+}
+
+int
+da_system_uid(
+    const char* user)
+{
+    return da_system_db_lookup(&da_system_passwd, user);
+}
+
+int
+da_system_gid(
+    const char* group)
+{
+    return da_system_db_lookup(&da_system_group, group);
 }
 
 /*
@@ -506,6 +506,393 @@ Groups:	garbage \n\
 CapEff:	fffffff008003420\n");
 }
 
+/*==========================================================================*
+ * Numbers
+ *==========================================================================*/
+
+static
+void
+test_cred_numbers(
+    void)
+{
+    static const gid_t groups[] = { 5, 7, 8, 255 };
+    static const DACred expected = {
+        16, 8,
+        groups, G_N_ELEMENTS(groups),
+        G_GUINT64_CONSTANT(0x1f),
+        DBUSACCESS_CRED_CAPS | DBUSACCESS_CRED_GROUPS
+    };
+    test_cred_parse_and_compare(&expected, "\
+Uid:	0	0x10	0	0\n\
+Gid:	0	010	0	0\n\
+Groups:	+5 0x 7 08 010 -1 4294967296 0XfF\n\
+CapEff:	0x1F\n");
+}
+
+/*==========================================================================*
+ * Keys
+ *==========================================================================*/
+
+static
+void
+test_cred_keys(
+    void)
+{
+    static const gid_t groups[] = { 3 };
+    static const DACred expected = {
+        1, 2,
+        groups, G_N_ELEMENTS(groups),
+        4,
+        DBUSACCESS_CRED_CAPS | DBUSACCESS_CRED_GROUPS
+    };
+    test_cred_parse_and_compare(&expected, "\
+Ui:	9	9	9	9\n\
+Uidx:	9	9	9	9\n\
+Uid :	9	9	9	9\n\
+Gi\n\
+Gid\n\
+Group:	9\n\
+GroupsX:	9\n\
+Cap:	9\n\
+CapEffective:	9\n\
+:\n\
+  uID:	0	1	0	0\n\
+gId:	0	2	0	0\n\
+GROUPS:	3\n\
+capeff:	4\n");
+}
+
+/*==========================================================================*
+ * Chunked
+ *==========================================================================*/
+
+static const char test_cred_chunked_data[] = "\
+Name:	test\n\
+Uid:	1000	1001	1000	1000\n\
+Gid:	2000	2001	2000	2000\n\
+Groups:	39 100 \n\
+CapEff:	00000000000000ff\n\
+Cpus_allowed:	ff\n";
+
+static
+gboolean
+test_cred_parse_chunked(
+    DACred* cred,
+    DACredPriv* priv,
+    guint32 fields,
+    gsize chunk,
+    gsize* total_read)
+{
+    const char* data = test_cred_chunked_data;
+    const gsize size = strlen(data);
+    char* buf = g_malloc(size);
+    DACredParser parser;
+    gsize len = 0, pos = 0;
+    gboolean ok;
+
+    da_cred_parser_init(&parser, cred, priv, fields);
+    for (;;) {
+        const gsize n = MIN(chunk, size - pos);
+
+        if (!n) {
+            da_cred_parser_feed(&parser, buf, len, TRUE);
+            break;
+        } else {
+            gsize used;
+
+            memcpy(buf + len, data + pos, n);
+            pos += n;
+            len += n;
+            used = da_cred_parser_feed(&parser, buf, len, FALSE);
+            if (da_cred_parser_done(&parser)) {
+                break;
+            }
+            memmove(buf, buf + used, len - used);
+            len -= used;
+        }
+    }
+    ok = da_cred_parser_finish(&parser);
+    *total_read = pos;
+    g_free(buf);
+    return ok;
+}
+
+static
+void
+test_cred_chunked(
+    void)
+{
+    const gsize size = strlen(test_cred_chunked_data);
+    gsize chunk, total = 0;
+
+    for (chunk = 1; chunk <= size; chunk++) {
+        DACred cred;
+        DACredPriv priv;
+
+        /* All fields */
+        memset(&priv, 0, sizeof(priv));
+        memset(&cred, 0, sizeof(cred));
+        g_assert(test_cred_parse_chunked(&cred, &priv, DBUSACCESS_CRED_ALL,
+            chunk, &total));
+        g_assert_cmpuint(cred.euid, == ,1001);
+        g_assert_cmpuint(cred.egid, == ,2001);
+        g_assert_cmpuint(cred.ngroups, == ,2);
+        g_assert_cmpuint(cred.groups[0], == ,39);
+        g_assert_cmpuint(cred.groups[1], == ,100);
+        g_assert_cmpuint(cred.caps, == ,0xff);
+        g_assert_cmpuint(cred.flags, == ,DBUSACCESS_CRED_ALL);
+        da_cred_priv_cleanup(&priv);
+
+        /* Uid and Gid only, stops before Groups */
+        memset(&priv, 0, sizeof(priv));
+        memset(&cred, 0, sizeof(cred));
+        g_assert(test_cred_parse_chunked(&cred, &priv, 0, chunk, &total));
+        g_assert_cmpuint(cred.euid, == ,1001);
+        g_assert_cmpuint(cred.egid, == ,2001);
+        g_assert_cmpuint(cred.ngroups, == ,0);
+        g_assert_cmpuint(cred.flags, == ,0);
+        g_assert(!priv.groups);
+        g_assert_cmpuint(total, < ,strstr(test_cred_chunked_data,
+            "Groups:") - test_cred_chunked_data + chunk);
+        da_cred_priv_cleanup(&priv);
+    }
+}
+
+/*==========================================================================*
+ * Inline groups
+ *==========================================================================*/
+
+static
+void
+test_cred_inline_groups_parse(
+    guint count)
+{
+    GString* buf = g_string_new("Uid:\t1\t1\t1\t1\nGid:\t2\t2\t2\t2\n");
+    DACred cred;
+    DACredPriv priv;
+    guint i;
+
+    g_string_append(buf, "Groups:");
+    for (i = 0; i < count; i++) {
+        g_string_append_printf(buf, " %u", i + 100);
+    }
+    g_string_append(buf, "\nCapEff:\t0\n");
+
+    memset(&priv, 0, sizeof(priv));
+    memset(&cred, 0, sizeof(cred));
+    g_assert(da_cred_parse(&cred, &priv, buf->str, buf->len));
+    g_assert_cmpuint(cred.ngroups, == ,count);
+    for (i = 0; i < count; i++) {
+        g_assert_cmpuint(cred.groups[i], == ,i + 100);
+    }
+    if (count <= DA_CRED_INLINE_GROUPS) {
+        g_assert(priv.groups == priv.inline_groups);
+    } else {
+        g_assert(priv.groups != priv.inline_groups);
+    }
+    da_cred_priv_cleanup(&priv);
+    g_assert(!priv.groups);
+    g_string_free(buf, TRUE);
+}
+
+static
+void
+test_cred_inline_groups(
+    void)
+{
+    DACredPriv priv;
+
+    test_cred_inline_groups_parse(1);
+    test_cred_inline_groups_parse(DA_CRED_INLINE_GROUPS);
+    test_cred_inline_groups_parse(DA_CRED_INLINE_GROUPS + 1);
+    test_cred_inline_groups_parse(1000);
+
+    /* Reallocation releases the previous storage */
+    memset(&priv, 0, sizeof(priv));
+    g_assert(da_cred_priv_groups(&priv, 2) == priv.inline_groups);
+    g_assert(da_cred_priv_groups(&priv, 100) != priv.inline_groups);
+    g_assert(da_cred_priv_groups(&priv, 200) != priv.inline_groups);
+    g_assert(da_cred_priv_groups(&priv, 0) == priv.inline_groups);
+    da_cred_priv_cleanup(&priv);
+    g_assert(!priv.groups);
+}
+
+/*==========================================================================*
+ * Prepared
+ *==========================================================================*/
+
+static
+void
+test_cred_prepared(
+    void)
+{
+    static const gid_t groups[] = { 100, 39, 1000, 39, 100000, 103 };
+    static const gid_t sorted[] = { 39, 100, 103, 1000, 100000 };
+    static const DACred cred = {
+        100000, 998,
+        groups, G_N_ELEMENTS(groups),
+        0,
+        DBUSACCESS_CRED_CAPS | DBUSACCESS_CRED_GROUPS
+    };
+    static const DACred nogroups = { 1, 2, NULL, 0, 0, 0 };
+    DACredPrepared* prepared = da_cred_prepared_new(&cred);
+    guint i;
+
+    g_assert(prepared);
+    g_assert(prepared->cred.euid == cred.euid);
+    g_assert(prepared->cred.egid == cred.egid);
+    g_assert(prepared->cred.flags == cred.flags);
+    g_assert(prepared->cred.ngroups == G_N_ELEMENTS(sorted));
+    for (i = 0; i < G_N_ELEMENTS(sorted); i++) {
+        g_assert(prepared->cred.groups[i] == sorted[i]);
+        g_assert(da_cred_prepared_has_group(prepared, sorted[i]));
+    }
+    g_assert(da_cred_prepared_has_group(prepared, 998));
+    g_assert(!da_cred_prepared_has_group(prepared, 0));
+    g_assert(!da_cred_prepared_has_group(prepared, 101));
+    g_assert(!da_cred_prepared_has_group(prepared, 39 + 64));
+    da_cred_prepared_unref(prepared);
+
+    prepared = da_cred_prepared_new(&nogroups);
+    g_assert(prepared);
+    g_assert(!prepared->cred.groups);
+    g_assert(!prepared->cred.ngroups);
+    g_assert(da_cred_prepared_has_group(prepared, 2));
+    g_assert(!da_cred_prepared_has_group(prepared, 1));
+    da_cred_prepared_unref(prepared);
+}
+
+/*==========================================================================*
+ * Intern
+ *==========================================================================*/
+
+static
+void
+test_cred_intern(
+    void)
+{
+    static const gid_t groups1[] = { 100, 39, 1000, 39, 103 };
+    static const gid_t groups2[] = { 1000, 103, 100, 39 };
+    static const gid_t sorted[] = { 39, 100, 103, 1000 };
+    static const DACred cred1 = {
+        100000, 998,
+        groups1, G_N_ELEMENTS(groups1),
+        0x1f,
+        DBUSACCESS_CRED_CAPS | DBUSACCESS_CRED_GROUPS
+    };
+    static const DACred cred2 = {
+        100000, 998,
+        groups2, G_N_ELEMENTS(groups2),
+        0x1f,
+        DBUSACCESS_CRED_CAPS | DBUSACCESS_CRED_GROUPS
+    };
+    DACred cred3 = cred2;
+    DACredPrepared* p1;
+    DACredPrepared* p2;
+    DACredPrepared* p3;
+    guint i;
+
+    g_assert(!da_cred_prepared_intern(NULL));
+
+    /* Same set of groups in a different order */
+    p1 = da_cred_prepared_intern(&cred1);
+    p2 = da_cred_prepared_intern(&cred2);
+    g_assert(p1);
+    g_assert(p1 == p2);
+    g_assert(p1->cred.ngroups == G_N_ELEMENTS(sorted));
+    for (i = 0; i < G_N_ELEMENTS(sorted); i++) {
+        g_assert(p1->cred.groups[i] == sorted[i]);
+    }
+    g_assert(da_cred_prepared_has_group(p1, 998));
+    g_assert(da_cred_prepared_has_group(p1, 1000));
+    g_assert(!da_cred_prepared_has_group(p1, 101));
+
+    /* Regular prepared credentials aren't interned */
+    p3 = da_cred_prepared_new(&cred1);
+    g_assert(p3 != p1);
+    da_cred_prepared_unref(p3);
+
+    /* Any difference produces a different record */
+    cred3.caps = 0x0f;
+    p3 = da_cred_prepared_intern(&cred3);
+    g_assert(p3 != p1);
+    da_cred_prepared_unref(p3);
+
+    cred3 = cred2;
+    cred3.ngroups--;
+    p3 = da_cred_prepared_intern(&cred3);
+    g_assert(p3 != p1);
+    da_cred_prepared_unref(p3);
+
+    cred3 = cred2;
+    cred3.flags = DBUSACCESS_CRED_CAPS;
+    cred3.groups = NULL;
+    cred3.ngroups = 0;
+    p3 = da_cred_prepared_intern(&cred3);
+    g_assert(p3 != p1);
+    g_assert(!p3->cred.groups);
+    g_assert(p3 == da_cred_prepared_intern(&cred3));
+    da_cred_prepared_unref(p3);
+    da_cred_prepared_unref(p3);
+
+    /* The record survives until the last reference is gone */
+    da_cred_prepared_unref(p2);
+    p2 = da_cred_prepared_intern(&cred2);
+    g_assert(p1 == p2);
+    da_cred_prepared_unref(p1);
+    da_cred_prepared_unref(da_cred_prepared_ref(p2));
+    da_cred_prepared_unref(p2);
+}
+
+/*==========================================================================*
+ * Performance tests (only run with -m perf)
+ *==========================================================================*/
+
+static
+void
+test_cred_perf_parse_data(
+    const char* name,
+    const char* data,
+    gsize len)
+{
+    const guint n = 100000;
+    double sec;
+    guint i;
+
+    g_test_timer_start();
+    for (i = 0; i < n; i++) {
+        DACred cred;
+        DACredPriv priv;
+
+        memset(&priv, 0, sizeof(priv));
+        memset(&cred, 0, sizeof(cred));
+        g_assert(da_cred_parse(&cred, &priv, data, len));
+        da_cred_priv_cleanup(&priv);
+    }
+    sec = g_test_timer_elapsed();
+    g_test_minimized_result(sec, "%s: %u parses in %.3f ms (%.0f per sec)",
+        name, n, sec * 1000, n / sec);
+}
+
+static
+void
+test_cred_perf_parse(
+    void)
+{
+    static const char* files[] = { "/proc/self/status", "/proc/1/status" };
+    guint i;
+
+    for (i = 0; i < G_N_ELEMENTS(files); i++) {
+        gchar* data = NULL;
+        gsize len = 0;
+
+        if (g_file_get_contents(files[i], &data, &len, NULL)) {
+            test_cred_perf_parse_data(files[i], data, len);
+            g_free(data);
+        }
+    }
+}
+
 /*==========================================================================*
  * Common
  *==========================================================================*/
@@ -530,6 +917,15 @@ int main(int argc, char* argv[])
     g_test_add_func(TEST_PREFIX "badgid", test_cred_badgid);
     g_test_add_func(TEST_PREFIX "badgroup1", test_cred_badgroup1);
     g_test_add_func(TEST_PREFIX "badgroup2", test_cred_badgroup2);
+    g_test_add_func(TEST_PREFIX "numbers", test_cred_numbers);
+    g_test_add_func(TEST_PREFIX "keys", test_cred_keys);
+    g_test_add_func(TEST_PREFIX "chunked", test_cred_chunked);
+    g_test_add_func(TEST_PREFIX "inline_groups", test_cred_inline_groups);
+    g_test_add_func(TEST_PREFIX "prepared", test_cred_prepared);
+    g_test_add_func(TEST_PREFIX "intern", test_cred_intern);
+    if (g_test_perf()) {
+        g_test_add_func(TEST_PREFIX "perf/parse", test_cred_perf_parse);
+    }
     test_init(&test_opt, argc, argv);
     return g_test_run();
 }
@@ -34,16 +34,25 @@
 
 #include "dbusaccess_parser_p.h"
 #include "dbusaccess_policy.h"
+#include "dbusaccess_cred.h"
+
+#include <glib/gstdio.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 static TestOpt test_opt;
 
 #define V DA_POLICY_VERSION
 #define VPLUS "2"
 
+static int test_system_uid_calls = 0;
+static int test_system_gid_calls = 0;
+
 int
 da_system_uid(
     const char* user)
 {
+    g_atomic_int_inc(&test_system_uid_calls);
     if (!g_strcmp0(user, "user")) {
         return 1;
     } else {
@@ -55,6 +64,7 @@ int
 da_system_gid(
     const char* group)
 {
+    g_atomic_int_inc(&test_system_gid_calls);
     if (!g_strcmp0(group, "group")) {
         return 1;
     } else {
@@ -202,6 +212,754 @@ test_policy_groups(
     da_policy_unref(policy);
 }
 
+/*==========================================================================*
+ * CredFields
+ *==========================================================================*/
+
+static
+void
+test_policy_cred_fields(
+    void)
+{
+    static const struct test_policy_cred_fields_data {
+        const char* spec;
+        guint32 fields;
+    } tests[] = {
+        { V ";*=deny", 0 },
+        { V ";user(1)=deny", 0 },
+        { V ";user(1)|!user(2)=deny", 0 },
+        { V ";group(1)=deny", DBUSACCESS_CRED_GROUPS },
+        { V ";user(1)=allow;!group(2)=deny", DBUSACCESS_CRED_GROUPS },
+        { V ";user(1)&(user(2)|group(3))=deny", DBUSACCESS_CRED_GROUPS }
+    };
+    guint i;
+
+    g_assert_cmpuint(da_policy_cred_fields(NULL), == ,0);
+    for (i = 0; i < G_N_ELEMENTS(tests); i++) {
+        DAPolicy* policy = da_policy_new(tests[i].spec);
+
+        g_assert(policy);
+        g_assert_cmpuint(da_policy_cred_fields(policy), == ,tests[i].fields);
+        da_policy_unref(policy);
+    }
+}
+
+/*==========================================================================*
+ * Prepared
+ *==========================================================================*/
+
+static
+void
+test_policy_prepared(
+    void)
+{
+    static const gid_t g23 [] = { 3, 2, 3 };
+    static const gid_t g43 [] = { 4, 3, 65 };
+    static const DACred root = { 0, 0, NULL, 0, 0, 0 };
+    static const DACred user123 = { 1, 1, g23, G_N_ELEMENTS(g23), 0, 0 };
+    static const DACred user543 = { 1, 5, g43, G_N_ELEMENTS(g43), 0, 0 };
+    DAPolicy* policy = da_policy_new(V "; group(1) | group(2) | "
+        "user(baduser:badgroup) = deny");
+    DACredPrepared* p0 = da_cred_prepared_new(&root);
+    DACredPrepared* p1 = da_cred_prepared_new(&user123);
+    DACredPrepared* p2 = da_cred_prepared_new(&user543);
+
+    g_assert(policy);
+    g_assert(p0);
+    g_assert(p1);
+    g_assert(p2);
+
+    /* NULL resistance */
+    g_assert(!da_cred_prepared_new(NULL));
+    g_assert(!da_cred_prepared_ref(NULL));
+    da_cred_prepared_unref(NULL);
+    g_assert(da_policy_check_prepared(NULL, NULL, 0, NULL, DA_ACCESS_DENY) ==
+        DA_ACCESS_DENY);
+    g_assert(da_policy_check_prepared(policy, NULL, 0, NULL,
+        DA_ACCESS_ALLOW) == DA_ACCESS_ALLOW);
+
+    /* Root is still root */
+    g_assert(da_policy_check_prepared(NULL, p0, 0, NULL, DA_ACCESS_DENY) ==
+        DA_ACCESS_ALLOW);
+
+    /* Group 2 is on the list, group 65 shares the bit with group 1 */
+    g_assert(da_policy_check_prepared(policy, p1, 0, NULL, DA_ACCESS_ALLOW) ==
+        DA_ACCESS_DENY);
+    g_assert(da_policy_check_prepared(policy, p2, 0, NULL, DA_ACCESS_ALLOW) ==
+        DA_ACCESS_ALLOW);
+    g_assert(da_policy_check_prepared(policy, p2, 0, NULL, DA_ACCESS_DENY) ==
+        DA_ACCESS_DENY);
+
+    g_assert(da_cred_prepared_ref(p1) == p1);
+    da_cred_prepared_unref(p1);
+    da_cred_prepared_unref(p0);
+    da_cred_prepared_unref(p1);
+    da_cred_prepared_unref(p2);
+    da_policy_unref(policy);
+}
+
+/*==========================================================================*
+ * Buffer
+ *==========================================================================*/
+
+static
+void
+test_policy_buffer(
+    void)
+{
+    static const char spec[] = V ";*=deny;user(1)=allow;group(2)=allow";
+    static const char nul1[] = V ";*=deny\0;user(1)=allow";
+    static const char nul2[] = V ";*=deny;foo('a\0')=allow";
+    static const DA_ACTION foo [] = {
+        { "foo", 1, 1 },
+        { NULL }
+    };
+    DAPolicy* p1 = da_policy_new(spec);
+    DAPolicy* p2 = da_policy_new(V ";*=deny;user(1)=allow");
+    DAPolicy* policy;
+
+    g_assert(p1);
+    g_assert(p2);
+    g_assert(!da_policy_new_from_buffer(NULL, 1, NULL));
+    g_assert(!da_policy_new_from_buffer(NULL, 0, NULL));
+    g_assert(!da_policy_new_from_buffer(spec, 0, NULL));
+
+    /* Whole thing */
+    policy = da_policy_new_from_buffer(spec, strlen(spec), NULL);
+    g_assert(da_policy_equal(policy, p1));
+    da_policy_unref(policy);
+
+    /* Length limits the input, no NUL terminator needed */
+    policy = da_policy_new_from_buffer(spec, strlen(V ";*=deny;user(1)=allow"),
+        NULL);
+    g_assert(da_policy_equal(policy, p2));
+    da_policy_unref(policy);
+
+    /* Embedded NULs are rejected */
+    g_assert(!da_policy_new_from_buffer(nul1, sizeof(nul1) - 1, NULL));
+    g_assert(!da_policy_new_from_buffer(nul2, sizeof(nul2) - 1, foo));
+
+    da_policy_unref(p1);
+    da_policy_unref(p2);
+}
+
+/*==========================================================================*
+ * File
+ *==========================================================================*/
+
+static
+void
+test_policy_file(
+    void)
+{
+    static const char spec[] = V ";*=deny;user(1)=allow";
+    char* dir = g_dir_make_tmp("test_policy_XXXXXX", NULL);
+    char* file = g_build_filename(dir, "policy", NULL);
+    char* empty = g_build_filename(dir, "empty", NULL);
+    char* missing = g_build_filename(dir, "missing", NULL);
+    DAPolicy* p1 = da_policy_new(spec);
+    DAPolicy* p2;
+
+    g_assert(g_file_set_contents(file, spec, -1, NULL));
+    g_assert(g_file_set_contents(empty, "", 0, NULL));
+
+    g_assert(!da_policy_new_from_file(NULL, NULL));
+    g_assert(!da_policy_new_from_file(missing, NULL));
+    g_assert(!da_policy_new_from_file(empty, NULL));
+
+    p2 = da_policy_new_from_file(file, NULL);
+    g_assert(p2);
+    g_assert(da_policy_equal(p1, p2));
+    da_policy_unref(p1);
+    da_policy_unref(p2);
+
+    g_unlink(file);
+    g_unlink(empty);
+    g_rmdir(dir);
+    g_free(file);
+    g_free(empty);
+    g_free(missing);
+    g_free(dir);
+}
+
+/*==========================================================================*
+ * Compiler
+ *==========================================================================*/
+
+static
+void
+test_policy_compiler(
+    void)
+{
+    static const DA_ACTION actions [] = {
+        { "foo", 1, 1 },
+        { "bar", 2, 0 },
+        { "foo", 3, 0 }, /* Shadowed by the first one */
+        { NULL }
+    };
+    static const char spec1[] = V ";*=deny;foo('x y')|bar()=allow";
+    static const char spec2[] = V ";user(1)&foo(a)=deny";
+    DAPolicyCompiler* compiler = da_policy_compiler_new(actions,
+        DA_POLICY_FLAGS_NONE);
+    DAPolicy* p1 = da_policy_new_full(spec1, actions);
+    DAPolicy* p2 = da_policy_new_full(spec2, actions);
+    DAPolicy* policy;
+
+    g_assert(compiler);
+    g_assert(p1);
+    g_assert(p2);
+
+    /* NULL resistance */
+    g_assert(!da_policy_compiler_ref(NULL));
+    da_policy_compiler_unref(NULL);
+    g_assert(!da_policy_compiler_compile(NULL, spec1));
+    g_assert(!da_policy_compiler_compile(compiler, NULL));
+    g_assert(!da_policy_compiler_compile_buffer(compiler, NULL, 1));
+
+    /* Compile the same thing a few times */
+    policy = da_policy_compiler_compile(compiler, spec1);
+    g_assert(da_policy_equal(policy, p1));
+    da_policy_unref(policy);
+    policy = da_policy_compiler_compile(compiler, spec2);
+    g_assert(da_policy_equal(policy, p2));
+    da_policy_unref(policy);
+
+    /* Errors leave the compiler usable (including unterminated quote) */
+    g_assert(!da_policy_compiler_compile(compiler, V ";foo()"));
+    g_assert(!da_policy_compiler_compile(compiler, V ";foo(\"x"));
+    g_assert(!da_policy_compiler_compile(compiler, V ";foo(x"));
+    policy = da_policy_compiler_compile_buffer(compiler, spec1,
+        sizeof(spec1) - 1);
+    g_assert(da_policy_equal(policy, p1));
+    da_policy_unref(policy);
+
+    /* Policy outlives the compiler */
+    g_assert(da_policy_compiler_ref(compiler) == compiler);
+    da_policy_compiler_unref(compiler);
+    policy = da_policy_compiler_compile(compiler, spec2);
+    da_policy_compiler_unref(compiler);
+    g_assert(da_policy_equal(policy, p2));
+    da_policy_unref(policy);
+
+    da_policy_unref(p1);
+    da_policy_unref(p2);
+}
+
+/*==========================================================================*
+ * Table
+ *==========================================================================*/
+
+static
+void
+test_policy_table(
+    void)
+{
+    static const DA_ACTION actions [] = {
+        { "foo", 1, 1 },
+        { "bar", 2, 0 },
+        { NULL }
+    };
+    static const DA_ACTION zero_id [] = {
+        { "foo", 1, 1 },
+        { "bar", 0, 0 },
+        { NULL }
+    };
+    static const DA_ACTION dup_id [] = {
+        { "foo", 1, 1 },
+        { "bar", 1, 0 },
+        { NULL }
+    };
+    static const DA_ACTION dup_name [] = {
+        { "foo", 1, 1 },
+        { "foo", 2, 0 },
+        { NULL }
+    };
+    static const char spec[] = V ";*=deny;foo('x y')|bar()=allow";
+    DAActionTable* table = da_action_table_new(actions);
+    DAActionTable* empty = da_action_table_new(NULL);
+    DAPolicyCompiler* compiler;
+    DAPolicy* p1 = da_policy_new_full(spec, actions);
+    DAPolicy* p2;
+    const DA_ACTION* action;
+
+    g_assert(table);
+    g_assert(empty);
+    g_assert(p1);
+
+    /* NULL resistance */
+    g_assert(!da_action_table_ref(NULL));
+    da_action_table_unref(NULL);
+    g_assert(!da_action_table_find(NULL, "foo"));
+    g_assert(!da_action_table_find(table, NULL));
+    g_assert(!da_policy_new_with_table(NULL, table, DA_POLICY_FLAGS_NONE));
+
+    /* Validation */
+    g_assert(!da_action_table_new(zero_id));
+    g_assert(!da_action_table_new(dup_id));
+    g_assert(!da_action_table_new(dup_name));
+
+    /* Lookup */
+    action = da_action_table_find(table, "bar");
+    g_assert(action);
+    g_assert(action != actions + 1); /* It's a copy */
+    g_assert(!g_strcmp0(action->name, "bar"));
+    g_assert(action->id == 2);
+    g_assert(!action->args);
+    g_assert(!da_action_table_find(table, "baz"));
+    g_assert(!da_action_table_find(empty, "foo"));
+
+    /* Compile */
+    p2 = da_policy_new_with_table(spec, table, DA_POLICY_FLAGS_NONE);
+    g_assert(da_policy_equal(p1, p2));
+    da_policy_unref(p2);
+    g_assert(!da_policy_new_with_table(spec, empty, DA_POLICY_FLAGS_NONE));
+    g_assert(!da_policy_new_with_table(spec, NULL, DA_POLICY_FLAGS_NONE));
+
+    /* The compiler holds its own reference */
+    compiler = da_policy_compiler_new_with_table(table, DA_POLICY_FLAGS_NONE);
+    g_assert(da_action_table_ref(table) == table);
+    da_action_table_unref(table);
+    da_action_table_unref(table);
+    p2 = da_policy_compiler_compile(compiler, spec);
+    g_assert(da_policy_equal(p1, p2));
+    da_policy_unref(p2);
+    da_policy_compiler_unref(compiler);
+
+    da_action_table_unref(empty);
+    da_policy_unref(p1);
+}
+
+/*==========================================================================*
+ * CompileAll
+ *==========================================================================*/
+
+static
+void
+test_policy_compile_all(
+    void)
+{
+    static const DA_ACTION actions [] = {
+        { "foo", 1, 1 },
+        { NULL }
+    };
+    static const char* specs[] = {
+        V ";*=deny;user(1)=allow",
+        V ";foo(a)&group(group)=deny",
+        V ";foo()", /* Broken */
+        NULL,
+        V ";user(user:group)|foo(b)",
+        V ";*=deny;group(2)=allow"
+    };
+    static const guint threads[] = { 1, 2, 0, 100 };
+    const guint n = G_N_ELEMENTS(specs);
+    DAActionTable* table = da_action_table_new(actions);
+    DAPolicy* expected[G_N_ELEMENTS(specs)];
+    DAPolicy* policies[G_N_ELEMENTS(specs)];
+    guint i, k;
+
+    g_assert(!da_policy_compile_all(NULL, n, table, 0, 0, policies));
+    g_assert(!da_policy_compile_all(specs, n, table, 0, 0, NULL));
+    g_assert(!da_policy_compile_all(specs, 0, table, 0, 0, policies));
+
+    for (i = 0; i < n; i++) {
+        expected[i] = da_policy_new_full(specs[i], actions);
+    }
+
+    for (k = 0; k < G_N_ELEMENTS(threads); k++) {
+        memset(policies, 0, sizeof(policies));
+        g_assert(da_policy_compile_all(specs, n, table, DA_POLICY_FLAGS_NONE,
+            threads[k], policies) == n - 2);
+        for (i = 0; i < n; i++) {
+            g_assert(!expected[i] == !policies[i]);
+            g_assert(da_policy_equal(expected[i], policies[i]));
+            da_policy_unref(policies[i]);
+        }
+    }
+
+    /* Custom actions are unknown without the table */
+    g_assert(da_policy_compile_all(specs, n, NULL, DA_POLICY_FLAGS_NONE, 0,
+        policies) == 2);
+    g_assert(policies[0]);
+    g_assert(policies[5]);
+    da_policy_unref(policies[0]);
+    da_policy_unref(policies[5]);
+
+    for (i = 0; i < n; i++) {
+        da_policy_unref(expected[i]);
+    }
+    da_action_table_unref(table);
+}
+
+/*==========================================================================*
+ * Quotes
+ *==========================================================================*/
+
+static
+void
+test_policy_quotes(
+    void)
+{
+    static const DA_ACTION actions [] = {
+        { "foo", 1, 1 },
+        { NULL }
+    };
+    static const DACred user = { 1, 1, NULL, 0, 0, 0 };
+    DAPolicy* policy = da_policy_new_full(V ";*=deny;"
+        "foo(\"/a b\\\"c\\d'e\nf\")=allow;"
+        "foo('/x y\\'z\\w\"v')=allow", actions);
+
+    g_assert(policy);
+    g_assert(da_policy_check(policy, &user, 1, "/a b\"c\\d'e\nf",
+        DA_ACCESS_DENY) == DA_ACCESS_ALLOW);
+    g_assert(da_policy_check(policy, &user, 1, "/x y'z\\w\"v",
+        DA_ACCESS_DENY) == DA_ACCESS_ALLOW);
+    g_assert(da_policy_check(policy, &user, 1, "/a b",
+        DA_ACCESS_ALLOW) == DA_ACCESS_DENY);
+    da_policy_unref(policy);
+
+    /* Octal numbers */
+    policy = da_policy_new(V ";*=deny;user(010)=allow");
+    g_assert(policy);
+    g_assert(da_policy_check(policy, &user, 0, NULL, DA_ACCESS_ALLOW) ==
+        DA_ACCESS_DENY);
+    da_policy_unref(policy);
+    g_assert(!da_policy_new(V ";user(08)"));
+}
+
+/*==========================================================================*
+ * Cache
+ *==========================================================================*/
+
+static
+char*
+test_policy_cache_file(
+    const char* dir)
+{
+    /* Returns the only file in the directory */
+    GDir* d = g_dir_open(dir, 0, NULL);
+    const char* name = g_dir_read_name(d);
+    char* path = g_build_filename(dir, name, NULL);
+
+    g_assert(name);
+    g_assert(!g_dir_read_name(d));
+    g_dir_close(d);
+    return path;
+}
+
+static
+void
+test_policy_cache_write(
+    const char* file,
+    const char* data,
+    gsize len)
+{
+    /* The umask could make the file group-writable, i.e. untrusted */
+    g_assert(g_file_set_contents(file, data, len, NULL));
+    g_assert(!g_chmod(file, 0600));
+}
+
+static
+void
+test_policy_cache(
+    void)
+{
+    static const DA_ACTION actions [] = {
+        { "foo", 1, 1 },
+        { NULL }
+    };
+    static const char spec1[] = V ";*=deny;!user(root:root)&foo('a b')|"
+        "group(1)=allow;user(0)=deny";
+    static const char spec2[] = V ";*=allow;foo(*)=deny";
+    static const char spec3[] = V ";*=deny;user(baduser)=allow";
+    char* dir = g_dir_make_tmp("test_policy_XXXXXX", NULL);
+    char* cache = g_build_filename(dir, "cache", NULL);
+    char* dir1 = g_build_filename(dir, "1", NULL);
+    char* dir2 = g_build_filename(dir, "2", NULL);
+    char* dir3 = g_build_filename(dir, "3", NULL);
+    char* file1;
+    char* file2;
+    char* data;
+    gsize len;
+    DAPolicy* p1 = da_policy_new_full(spec1, actions);
+    DAPolicy* p2 = da_policy_new_full(spec2, actions);
+    DAPolicy* lazy1 = da_policy_new_with_flags(spec1, actions,
+        DA_POLICY_FLAG_LAZY_NAMES);
+    DAPolicy* policy;
+    struct stat st;
+    mode_t mask;
+
+    g_assert(p1);
+    g_assert(p2);
+    g_assert(lazy1);
+
+    /* Compile each spec into its own directory */
+    da_policy_set_cache_dir(dir1);
+    mask = umask(0);
+    policy = da_policy_new_full(spec1, actions);
+    umask(mask);
+    g_assert(da_policy_equal(policy, p1));
+    da_policy_unref(policy);
+    file1 = test_policy_cache_file(dir1);
+
+    /* The file is private regardless of the umask */
+    g_assert(!g_stat(file1, &st));
+    g_assert_cmpuint(st.st_mode & 0777, == ,0600);
+
+    /* Load it back */
+    policy = da_policy_new_full(spec1, actions);
+    g_assert(da_policy_equal(policy, p1));
+    da_policy_unref(policy);
+
+    da_policy_set_cache_dir(dir2);
+    policy = da_policy_new_full(spec2, actions);
+    g_assert(da_policy_equal(policy, p2));
+    da_policy_unref(policy);
+    file2 = test_policy_cache_file(dir2);
+
+    /* Substitute the cached data to make sure that it's actually used */
+    g_assert(g_file_get_contents(file2, &data, &len, NULL));
+    da_policy_set_cache_dir(dir1);
+    test_policy_cache_write(file1, data, len);
+    policy = da_policy_new_full(spec1, actions);
+    g_assert(da_policy_equal(policy, p2));
+    da_policy_unref(policy);
+
+    /* Files writable by others are ignored (and overwritten) */
+    g_assert(!g_chmod(file1, 0620));
+    policy = da_policy_new_full(spec1, actions);
+    g_assert(da_policy_equal(policy, p1));
+    da_policy_unref(policy);
+
+    /* So are the files in a directory writable by others */
+    test_policy_cache_write(file1, data, len);
+    g_assert(!g_chmod(dir1, 0777));
+    policy = da_policy_new_full(spec1, actions);
+    g_assert(da_policy_equal(policy, p1));
+    da_policy_unref(policy);
+    g_assert(!g_chmod(dir1, 0700));
+
+    /* And symbolic links */
+    g_unlink(file1);
+    g_assert(!symlink(file2, file1));
+    policy = da_policy_new_full(spec1, actions);
+    g_assert(da_policy_equal(policy, p1));
+    da_policy_unref(policy);
+    g_assert(!g_file_test(file1, G_FILE_TEST_IS_SYMLINK));
+
+    /* Broken files are ignored and overwritten */
+    test_policy_cache_write(file1, data, len - 1);
+    policy = da_policy_new_full(spec1, actions);
+    g_assert(da_policy_equal(policy, p1));
+    da_policy_unref(policy);
+    g_free(data);
+    policy = da_policy_new_full(spec1, actions);
+    g_assert(da_policy_equal(policy, p1));
+    da_policy_unref(policy);
+
+    /* Lazy names survive the round trip */
+    da_policy_set_cache_dir(cache);
+    policy = da_policy_new_with_flags(spec1, actions,
+        DA_POLICY_FLAG_LAZY_NAMES);
+    da_policy_unref(policy);
+    policy = da_policy_new_with_flags(spec1, actions,
+        DA_POLICY_FLAG_LAZY_NAMES);
+    g_assert(da_policy_equal(policy, lazy1));
+    da_policy_unref(policy);
+
+    /* Broken specs aren't cached */
+    g_unlink(file1);
+    da_policy_set_cache_dir(dir1);
+    g_assert(!da_policy_new_full(V ";foo()", actions));
+    g_assert(!g_rmdir(dir1));
+
+    /* Neither are the results of failed name lookups... */
+    da_policy_set_cache_dir(dir3);
+    policy = da_policy_new_full(spec3, actions);
+    g_assert(policy);
+    da_policy_unref(policy);
+    g_assert(!g_file_test(dir3, G_FILE_TEST_EXISTS));
+
+    /* ...unless the names are resolved lazily */
+    policy = da_policy_new_with_flags(spec3, actions,
+        DA_POLICY_FLAG_LAZY_NAMES);
+    g_assert(policy);
+    da_policy_unref(policy);
+    g_free(file1);
+    file1 = test_policy_cache_file(dir3);
+    g_unlink(file1);
+    g_assert(!g_rmdir(dir3));
+
+    da_policy_set_cache_dir(NULL);
+    g_free(file1);
+    file1 = test_policy_cache_file(cache);
+    g_unlink(file1);
+    g_unlink(file2);
+    g_rmdir(cache);
+    g_rmdir(dir2);
+    g_rmdir(dir);
+    g_free(file1);
+    g_free(file2);
+    g_free(cache);
+    g_free(dir1);
+    g_free(dir2);
+    g_free(dir3);
+    g_free(dir);
+    da_policy_unref(p1);
+    da_policy_unref(p2);
+    da_policy_unref(lazy1);
+}
+
+/*==========================================================================*
+ * Shared
+ *==========================================================================*/
+
+#define TEST_SHARED_SPEC V ";*=deny;user(1)&foo(*)=allow"
+#define TEST_SHARED_THREADS (4)
+#define TEST_SHARED_LOOPS (10000)
+
+static const DA_ACTION test_policy_shared_actions [] = {
+    { "foo", 1, 1 },
+    { NULL }
+};
+
+static
+gpointer
+test_policy_shared_thread(
+    gpointer data)
+{
+    DAPolicy* expected = data;
+    int i;
+
+    for (i = 0; i < TEST_SHARED_LOOPS; i++) {
+        DAPolicy* policy = da_policy_new_shared(TEST_SHARED_SPEC,
+            test_policy_shared_actions);
+        g_assert(da_policy_equal(policy, expected));
+        da_policy_unref(policy);
+    }
+    return NULL;
+}
+
+static
+void
+test_policy_shared(
+    void)
+{
+    static const DA_ACTION other [] = {
+        { "foo", 2, 1 },
+        { NULL }
+    };
+    DAPolicy* p1 = da_policy_new_shared(TEST_SHARED_SPEC,
+        test_policy_shared_actions);
+    DAPolicy* p2 = da_policy_new_shared(TEST_SHARED_SPEC,
+        test_policy_shared_actions);
+    DAPolicy* p3 = da_policy_new_shared(TEST_SHARED_SPEC, other);
+    DAPolicy* p4 = da_policy_new_shared(V ";*=deny", NULL);
+    DAPolicy* p5 = da_policy_new_shared(V ";*=deny", NULL);
+    DAPolicy* plain = da_policy_new_full(TEST_SHARED_SPEC,
+        test_policy_shared_actions);
+    GThread* threads[TEST_SHARED_THREADS];
+    int i;
+
+    g_assert(!da_policy_new_shared(NULL, NULL));
+    g_assert(!da_policy_new_shared(V ";foo()", test_policy_shared_actions));
+    g_assert(p1);
+    g_assert(p3);
+    g_assert(p4);
+    g_assert(p1 == p2);
+    g_assert(p1 != p3);
+    g_assert(p4 == p5);
+    g_assert(p1 != plain);
+    g_assert(da_policy_equal(p1, plain));
+    da_policy_unref(p2);
+    da_policy_unref(p3);
+    da_policy_unref(p4);
+    da_policy_unref(p5);
+
+    /* Shared policy is still there, p1 holds a reference to it */
+    p2 = da_policy_new_shared(TEST_SHARED_SPEC, test_policy_shared_actions);
+    g_assert(p1 == p2);
+    da_policy_unref(p2);
+
+    /* Threads keep grabbing and dropping the last reference */
+    da_policy_unref(p1);
+    for (i = 0; i < TEST_SHARED_THREADS; i++) {
+        threads[i] = g_thread_new("test", test_policy_shared_thread, plain);
+    }
+    for (i = 0; i < TEST_SHARED_THREADS; i++) {
+        g_thread_join(threads[i]);
+    }
+    da_policy_unref(plain);
+}
+
+/*==========================================================================*
+ * Lazy
+ *==========================================================================*/
+
+static
+void
+test_policy_lazy(
+    void)
+{
+    static const DACred user1 = { 1, 1, NULL, 0, 0, 0 };
+    static const DACred user2 = { 2, 1, NULL, 0, 0, 0 };
+    DAPolicy* lazy;
+    DAPolicy* lazy2;
+    DAPolicy* eager;
+    DAPolicy* unknown;
+
+    test_system_uid_calls = test_system_gid_calls = 0;
+    lazy = da_policy_new_with_flags(V ";*=deny;user(user:group)=allow",
+        NULL, DA_POLICY_FLAG_LAZY_NAMES);
+    lazy2 = da_policy_new_with_flags(V ";*=deny;user(user:group)=allow",
+        NULL, DA_POLICY_FLAG_LAZY_NAMES);
+    unknown = da_policy_new_with_flags(V ";*=deny;user(baduser)=allow",
+        NULL, DA_POLICY_FLAG_LAZY_NAMES);
+    g_assert(lazy);
+    g_assert(lazy2);
+    g_assert(unknown);
+
+    /* Nothing has been resolved yet */
+    g_assert(!test_system_uid_calls);
+    g_assert(!test_system_gid_calls);
+
+    /* Names are compared as strings, without resolving them */
+    g_assert(da_policy_equal(lazy, lazy2));
+    g_assert(!da_policy_equal(lazy, unknown));
+    g_assert(!test_system_uid_calls);
+    g_assert(!test_system_gid_calls);
+
+    /* The first check resolves the names */
+    g_assert(da_policy_check(lazy, &user2, 0, NULL, DA_ACCESS_ALLOW) ==
+        DA_ACCESS_DENY);
+    g_assert(test_system_uid_calls == 1);
+    g_assert(test_system_gid_calls == 1);
+    g_assert(da_policy_check(lazy, &user1, 0, NULL, DA_ACCESS_DENY) ==
+        DA_ACCESS_ALLOW);
+    g_assert(test_system_uid_calls == 1);
+    g_assert(test_system_gid_calls == 1);
+
+    /* Resolving the names doesn't change the result */
+    g_assert(da_policy_equal(lazy, lazy2));
+    g_assert(da_policy_equal(lazy2, lazy));
+
+    /* Names are never equal to the ids resolved at compile time */
+    eager = da_policy_new(V ";*=deny;user(user:group)=allow");
+    test_system_uid_calls = test_system_gid_calls = 0;
+    g_assert(!da_policy_equal(lazy, eager));
+    g_assert(!da_policy_equal(eager, lazy2));
+    g_assert(!test_system_uid_calls);
+    g_assert(!test_system_gid_calls);
+
+    /* Unknown names don't match anything */
+    g_assert(da_policy_check(unknown, &user1, 0, NULL, DA_ACCESS_ALLOW) ==
+        DA_ACCESS_DENY);
+
+    da_policy_unref(lazy);
+    da_policy_unref(lazy2);
+    da_policy_unref(eager);
+    da_policy_unref(unknown);
+}
+
 /*==========================================================================*
  * Equal1
  *==========================================================================*/
@@ -749,6 +1507,253 @@ test_policy_check11(
      da_policy_unref(policy);
 }
 
+/*==========================================================================*
+ * Large
+ *==========================================================================*/
+
+static
+char*
+test_policy_large_spec(
+    guint n)
+{
+    /* Every uid is denied except for the last one */
+    GString* buf = g_string_new(V);
+    guint i;
+
+    for (i = 1; i <= n; i++) {
+        g_string_append_printf(buf, ";user(%u)=deny", i);
+    }
+    g_string_append_printf(buf, ";user(%u)=allow", n);
+    return g_string_free(buf, FALSE);
+}
+
+static
+void
+test_policy_large(
+    void)
+{
+    const guint n = 10000;
+    const DACred first = { 1, 1, NULL, 0, 0, 0 };
+    const DACred middle = { n/2, 1, NULL, 0, 0, 0 };
+    const DACred last = { n, 1, NULL, 0, 0, 0 };
+    const DACred other = { n + 1, 1, NULL, 0, 0, 0 };
+    char* spec = test_policy_large_spec(n);
+    DAPolicy* policy = da_policy_new(spec);
+
+    g_assert(policy);
+    g_assert(da_policy_check(policy, &first, 0, NULL, DA_ACCESS_ALLOW) ==
+        DA_ACCESS_DENY);
+    g_assert(da_policy_check(policy, &middle, 0, NULL, DA_ACCESS_ALLOW) ==
+        DA_ACCESS_DENY);
+    g_assert(da_policy_check(policy, &last, 0, NULL, DA_ACCESS_DENY) ==
+        DA_ACCESS_ALLOW);
+    g_assert(da_policy_check(policy, &other, 0, NULL, DA_ACCESS_DENY) ==
+        DA_ACCESS_DENY);
+    da_policy_unref(policy);
+    g_free(spec);
+}
+
+/*==========================================================================*
+ * Performance tests (only run with -m perf)
+ *==========================================================================*/
+
+static
+void
+test_policy_perf_compile(
+    void)
+{
+    static const guint sizes[] = { 10, 1000, 10000, 100000 };
+    guint i;
+
+    for (i = 0; i < G_N_ELEMENTS(sizes); i++) {
+        const guint n = sizes[i];
+        char* spec = test_policy_large_spec(n);
+        DAPolicy* policy;
+        double sec;
+
+        g_test_timer_start();
+        policy = da_policy_new(spec);
+        sec = g_test_timer_elapsed();
+        g_assert(policy);
+        g_test_minimized_result(sec, "%u entries compiled in %.3f ms "
+            "(%.3f us per entry)", n, sec * 1000, sec * 1000000 / n);
+        da_policy_unref(policy);
+        g_free(spec);
+    }
+}
+
+static
+void
+test_policy_perf_compiler(
+    void)
+{
+    static const DA_ACTION actions [] = {
+        { "get", 1, 1 },
+        { "set", 2, 1 },
+        { "call", 3, 1 },
+        { NULL }
+    };
+    const guint n = 200;
+    char** specs = g_new(char*, n);
+    DAPolicyCompiler* compiler;
+    double sec1, sec2;
+    guint i;
+
+    for (i = 0; i < n; i++) {
+        specs[i] = g_strdup_printf(V ";*=deny;group(%u)&get(Method%u)=allow;"
+            "user(%u)&(set(Method%u)|call(Method%u))=allow", i, i, i, i, i);
+    }
+
+    /* Fresh parser for each policy */
+    g_test_timer_start();
+    for (i = 0; i < n; i++) {
+        da_policy_unref(da_policy_new_full(specs[i], actions));
+    }
+    sec1 = g_test_timer_elapsed();
+
+    /* Same compiler for all of them */
+    g_test_timer_start();
+    compiler = da_policy_compiler_new(actions, DA_POLICY_FLAGS_NONE);
+    for (i = 0; i < n; i++) {
+        da_policy_unref(da_policy_compiler_compile(compiler, specs[i]));
+    }
+    da_policy_compiler_unref(compiler);
+    sec2 = g_test_timer_elapsed();
+
+    g_test_minimized_result(sec2, "%u policies compiled in %.3f ms "
+        "(%.3f ms without the compiler)", n, sec2 * 1000, sec1 * 1000);
+    for (i = 0; i < n; i++) {
+        g_free(specs[i]);
+    }
+    g_free(specs);
+}
+
+static
+void
+test_policy_perf_table(
+    void)
+{
+    const guint n = 200;
+    DA_ACTION* actions = g_new0(DA_ACTION, n + 1);
+    GString* buf = g_string_new(V ";*=deny");
+    DAActionTable* table;
+    DAPolicy* p1;
+    DAPolicy* p2;
+    double sec1, sec2;
+    guint i;
+
+    for (i = 0; i < n; i++) {
+        actions[i].name = g_strdup_printf("action%u", i);
+        actions[i].id = i + 1;
+        actions[i].args = 1;
+    }
+    for (i = 0; i < 20 * n; i++) {
+        g_string_append_printf(buf, ";group(%u)&action%u(x)=allow", i,
+            n - 1 - (i % n));
+    }
+
+    g_test_timer_start();
+    p1 = da_policy_new_full(buf->str, actions);
+    sec1 = g_test_timer_elapsed();
+
+    table = da_action_table_new(actions);
+    g_test_timer_start();
+    p2 = da_policy_new_with_table(buf->str, table, DA_POLICY_FLAGS_NONE);
+    sec2 = g_test_timer_elapsed();
+
+    g_assert(p1);
+    g_assert(da_policy_equal(p1, p2));
+    g_test_minimized_result(sec2, "%u terms, %u actions compiled in %.3f ms "
+        "(%.3f ms without the table)", 20 * n, n, sec2 * 1000, sec1 * 1000);
+
+    da_policy_unref(p1);
+    da_policy_unref(p2);
+    da_action_table_unref(table);
+    for (i = 0; i < n; i++) {
+        g_free((char*)actions[i].name);
+    }
+    g_free(actions);
+    g_string_free(buf, TRUE);
+}
+
+static
+void
+test_policy_perf_compile_all(
+    void)
+{
+    const guint n = 1000;
+    const long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+    const guint max_threads = (ncpu > 0) ? (guint)ncpu : 1;
+    char** specs = g_new(char*, n);
+    DAPolicy** policies = g_new(DAPolicy*, n);
+    double sec1 = 0;
+    guint i, threads;
+
+    for (i = 0; i < n; i++) {
+        specs[i] = test_policy_large_spec(100 + i % 10);
+    }
+
+    for (threads = 1; threads <= max_threads; threads *= 2) {
+        double sec;
+
+        g_test_timer_start();
+        g_assert(da_policy_compile_all((const char* const*)specs, n, NULL,
+            DA_POLICY_FLAGS_NONE, threads, policies) == n);
+        sec = g_test_timer_elapsed();
+        if (threads == 1) {
+            sec1 = sec;
+        }
+        g_test_minimized_result(sec, "%u policies on %u thread(s) compiled "
+            "in %.3f ms (%.2fx)", n, threads, sec * 1000, sec1 / sec);
+        for (i = 0; i < n; i++) {
+            da_policy_unref(policies[i]);
+        }
+    }
+
+    for (i = 0; i < n; i++) {
+        g_free(specs[i]);
+    }
+    g_free(specs);
+    g_free(policies);
+}
+
+static
+void
+test_policy_perf_scan(
+    void)
+{
+    static const DA_ACTION actions [] = {
+        { "path", 1, 1 },
+        { NULL }
+    };
+    static const guint sizes[] = { 1000, 10000, 100000 };
+    guint i;
+
+    for (i = 0; i < G_N_ELEMENTS(sizes); i++) {
+        const guint n = sizes[i];
+        GString* buf = g_string_new(V ";*=deny");
+        DAPolicy* policy;
+        double sec;
+        guint k;
+
+        for (k = 0; k < n; k++) {
+            g_string_append_printf(buf, ";group(%u)&path(\"/org/example/"
+                "service/object_%u/with a rather long name/*\")=allow",
+                k, k);
+        }
+
+        g_test_timer_start();
+        policy = da_policy_new_full(buf->str, actions);
+        sec = g_test_timer_elapsed();
+        g_assert(policy);
+        g_test_minimized_result(sec, "%u bytes scanned in %.3f ms "
+            "(%.1f MB/s)", (guint)buf->len, sec * 1000,
+            buf->len / sec / 1000000);
+        da_policy_unref(policy);
+        g_string_free(buf, TRUE);
+    }
+}
+
 /*==========================================================================*
  * Common
  *==========================================================================*/
@@ -762,6 +1767,17 @@ int main(int argc, char* argv[])
     g_test_add_func(TEST_PREFIX "broken", test_policy_broken);
     g_test_add_func(TEST_PREFIX "basic", test_policy_basic);
     g_test_add_func(TEST_PREFIX "groups", test_policy_groups);
+    g_test_add_func(TEST_PREFIX "cred_fields", test_policy_cred_fields);
+    g_test_add_func(TEST_PREFIX "prepared", test_policy_prepared);
+    g_test_add_func(TEST_PREFIX "buffer", test_policy_buffer);
+    g_test_add_func(TEST_PREFIX "file", test_policy_file);
+    g_test_add_func(TEST_PREFIX "compiler", test_policy_compiler);
+    g_test_add_func(TEST_PREFIX "table", test_policy_table);
+    g_test_add_func(TEST_PREFIX "compile_all", test_policy_compile_all);
+    g_test_add_func(TEST_PREFIX "quotes", test_policy_quotes);
+    g_test_add_func(TEST_PREFIX "cache", test_policy_cache);
+    g_test_add_func(TEST_PREFIX "shared", test_policy_shared);
+    g_test_add_func(TEST_PREFIX "lazy", test_policy_lazy);
     g_test_add_func(TEST_PREFIX "equal1", test_policy_equal1);
     g_test_add_func(TEST_PREFIX "equal2", test_policy_equal2);
     g_test_add_func(TEST_PREFIX "equal3", test_policy_equal3);
@@ -785,6 +1801,16 @@ int main(int argc, char* argv[])
     g_test_add_func(TEST_PREFIX "check9", test_policy_check9);
     g_test_add_func(TEST_PREFIX "check10", test_policy_check10);
     g_test_add_func(TEST_PREFIX "check11", test_policy_check11);
+    g_test_add_func(TEST_PREFIX "large", test_policy_large);
+    if (g_test_perf()) {
+        g_test_add_func(TEST_PREFIX "perf/compile", test_policy_perf_compile);
+        g_test_add_func(TEST_PREFIX "perf/compiler",
+            test_policy_perf_compiler);
+        g_test_add_func(TEST_PREFIX "perf/table", test_policy_perf_table);
+        g_test_add_func(TEST_PREFIX "perf/compile_all",
+            test_policy_perf_compile_all);
+        g_test_add_func(TEST_PREFIX "perf/scan", test_policy_perf_scan);
+    }
     test_init(&test_opt, argc, argv);
     return g_test_run();
 }
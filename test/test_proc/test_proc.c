@@ -33,20 +33,15 @@
 #include "test_common.h"
 
 #include "dbusaccess_self.h"
+#include "dbusaccess_proc_p.h"
 
-#include <stdlib.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <grp.h>
+#include <unistd.h>
 
 static TestOpt test_opt;
 
-static
-gboolean
-test_loop_quit(
-    gpointer data)
-{
-    g_main_loop_quit(data);
-    return G_SOURCE_REMOVE;
-}
-
 /*==========================================================================*
  * Invalid
  *==========================================================================*/
@@ -65,6 +60,393 @@ test_proc_invalid(
     g_assert(!da_proc_new((pid_t)0xffffffff));
 }
 
+/*==========================================================================*
+ * Pid
+ *==========================================================================*/
+
+static
+void
+test_proc_pid(
+    void)
+{
+    DAProc* proc = da_proc_new(getpid());
+
+    g_assert(proc);
+    g_assert_cmpuint(proc->pid, == ,getpid());
+    g_assert_cmpuint(proc->cred.euid, == ,geteuid());
+    g_assert_cmpuint(proc->cred.egid, == ,getegid());
+    g_assert_cmpuint(proc->cred.flags, == ,DBUSACCESS_CRED_ALL);
+    da_proc_unref(proc);
+}
+
+/*==========================================================================*
+ * Fields
+ *==========================================================================*/
+
+static
+void
+test_proc_fields(
+    void)
+{
+    DAProc* proc = da_proc_new_full(getpid(), 0);
+
+    /* Only euid and egid */
+    g_assert(proc);
+    g_assert_cmpuint(proc->cred.euid, == ,geteuid());
+    g_assert_cmpuint(proc->cred.egid, == ,getegid());
+    g_assert_cmpuint(proc->cred.flags, == ,0);
+    g_assert_cmpuint(proc->cred.ngroups, == ,0);
+    g_assert(!proc->cred.groups);
+    g_assert(!proc->cred.caps);
+    da_proc_unref(proc);
+
+    /* Groups but not caps */
+    proc = da_proc_new_full(getpid(), DBUSACCESS_CRED_GROUPS);
+    g_assert(proc);
+    g_assert_cmpuint(proc->cred.flags, == ,DBUSACCESS_CRED_GROUPS);
+    g_assert(!proc->cred.caps);
+    da_proc_unref(proc);
+
+    /* Caps but not groups */
+    proc = da_proc_new_full(getpid(), DBUSACCESS_CRED_CAPS);
+    g_assert(proc);
+    g_assert_cmpuint(proc->cred.flags, == ,DBUSACCESS_CRED_CAPS);
+    g_assert_cmpuint(proc->cred.ngroups, == ,0);
+    da_proc_unref(proc);
+
+    g_assert(!da_proc_new_full(0, DBUSACCESS_CRED_ALL));
+}
+
+/*==========================================================================*
+ * Socket
+ *==========================================================================*/
+
+static
+void
+test_proc_socket(
+    void)
+{
+    DAProc* self = da_proc_new(getpid());
+    DAProc* proc;
+    int fds[2];
+    guint i;
+
+    g_assert(self);
+    g_assert(!da_proc_new_from_socket(-1, DBUSACCESS_CRED_ALL));
+
+    /* Not a socket */
+    g_assert(!pipe(fds));
+    g_assert(!da_proc_new_from_socket(fds[0], DBUSACCESS_CRED_ALL));
+    close(fds[0]);
+    close(fds[1]);
+
+    g_assert(!socketpair(AF_UNIX, SOCK_STREAM, 0, fds));
+
+    /* Only uid and gid */
+    proc = da_proc_new_from_socket(fds[0], 0);
+    g_assert(proc);
+    g_assert_cmpuint(proc->pid, == ,getpid());
+    g_assert_cmpuint(proc->cred.euid, == ,geteuid());
+    g_assert_cmpuint(proc->cred.egid, == ,getegid());
+    g_assert_cmpuint(proc->cred.flags, == ,0);
+    g_assert_cmpuint(proc->cred.ngroups, == ,0);
+    da_proc_unref(proc);
+
+    /* Everything, must be the same as what /proc says */
+    proc = da_proc_new_from_socket(fds[1], DBUSACCESS_CRED_ALL);
+    g_assert(proc);
+    g_assert_cmpuint(proc->cred.flags, == ,self->cred.flags);
+    g_assert_cmpuint(proc->cred.caps, == ,self->cred.caps);
+    g_assert_cmpuint(proc->cred.ngroups, == ,self->cred.ngroups);
+    for (i = 0; i < proc->cred.ngroups; i++) {
+        g_assert_cmpuint(proc->cred.groups[i], == ,self->cred.groups[i]);
+    }
+    da_proc_unref(proc);
+
+    /* /proc is ignored if the process doesn't look like the peer */
+    proc = da_proc_new_from_peer(fds[1], getpid(), geteuid() + 1,
+        getegid(), DBUSACCESS_CRED_ALL);
+    g_assert(proc);
+    g_assert_cmpuint(proc->cred.euid, == ,geteuid() + 1);
+    g_assert(!(proc->cred.flags & DBUSACCESS_CRED_CAPS));
+    da_proc_unref(proc);
+    proc = da_proc_new_from_peer(fds[1], getpid(), geteuid(),
+        getegid() + 1, DBUSACCESS_CRED_CAPS);
+    g_assert(proc);
+    g_assert_cmpuint(proc->cred.egid, == ,getegid() + 1);
+    g_assert_cmpuint(proc->cred.flags, == ,0);
+    da_proc_unref(proc);
+
+    close(fds[0]);
+    close(fds[1]);
+    da_proc_unref(self);
+}
+
+/*==========================================================================*
+ * Pidfd
+ *==========================================================================*/
+
+static
+void
+test_proc_pidfd_exit(
+    DAProc* proc,
+    void* loop)
+{
+    g_assert(!da_proc_alive(proc));
+    g_main_loop_quit(loop);
+}
+
+static
+void
+test_proc_pidfd_not_reached(
+    DAProc* proc,
+    void* data)
+{
+    g_assert_not_reached();
+}
+
+static
+void
+test_proc_pidfd(
+    void)
+{
+    GMainLoop* loop = g_main_loop_new(NULL, FALSE);
+    DAProc* proc;
+    guint id;
+    pid_t pid;
+    int fds[2];
+
+    g_assert(!da_proc_new_pidfd(0, DBUSACCESS_CRED_ALL));
+    g_assert(!da_proc_alive(NULL));
+    g_assert_cmpint(da_proc_pidfd(NULL), == ,-1);
+    g_assert(!da_proc_add_exit_handler(NULL, test_proc_pidfd_exit, loop));
+    da_proc_remove_exit_handler(NULL, 0);
+
+    /* The child exits when the pipe gets closed */
+    g_assert(!pipe(fds));
+    pid = fork();
+    g_assert(pid >= 0);
+    if (!pid) {
+        char c;
+        close(fds[1]);
+        if (read(fds[0], &c, 1) < 0) {
+            _exit(1);
+        }
+        _exit(0);
+    }
+    close(fds[0]);
+
+    proc = da_proc_new_pidfd(pid, DBUSACCESS_CRED_ALL);
+    g_assert(proc);
+    g_assert_cmpuint(proc->pid, == ,pid);
+    g_assert(da_proc_alive(proc));
+    if (da_proc_pidfd(proc) >= 0) {
+        g_assert(!da_proc_add_exit_handler(proc, NULL, NULL));
+
+        /* This one gets removed before the process exits */
+        id = da_proc_add_exit_handler(proc, test_proc_pidfd_not_reached,
+            NULL);
+        g_assert(id);
+        da_proc_remove_exit_handler(proc, id);
+
+        g_assert(da_proc_add_exit_handler(proc, test_proc_pidfd_exit, loop));
+        close(fds[1]);
+        g_main_loop_run(loop);
+    } else {
+        /* No pidfd support in the kernel */
+        g_assert(!da_proc_add_exit_handler(proc, test_proc_pidfd_exit, loop));
+        close(fds[1]);
+    }
+    g_assert_cmpint(waitpid(pid, NULL, 0), == ,pid);
+    g_assert(!da_proc_alive(proc));
+
+    /* The process is gone */
+    g_assert(!da_proc_new_pidfd(pid, DBUSACCESS_CRED_ALL));
+    da_proc_unref(proc);
+    g_main_loop_unref(loop);
+}
+
+/*==========================================================================*
+ * Cache
+ *==========================================================================*/
+
+static
+pid_t
+test_proc_cache_child(
+    int* wfd)
+{
+    int fds[2];
+    pid_t pid;
+
+    /* The child exits when the pipe gets closed */
+    g_assert(!pipe(fds));
+    pid = fork();
+    g_assert(pid >= 0);
+    if (!pid) {
+        char c;
+        close(fds[1]);
+        if (read(fds[0], &c, 1) < 0) {
+            _exit(1);
+        }
+        _exit(0);
+    }
+    close(fds[0]);
+    *wfd = fds[1];
+    return pid;
+}
+
+static
+void
+test_proc_cache_reap(
+    pid_t pid,
+    int wfd)
+{
+    close(wfd);
+    g_assert_cmpint(waitpid(pid, NULL, 0), == ,pid);
+}
+
+static
+void
+test_proc_cache(
+    void)
+{
+    DAProcCache* cache = da_proc_cache_new(2, 60000, DBUSACCESS_CRED_ALL);
+    DAProcCache* shared = da_proc_cache_shared();
+    DAProcCache* shared2;
+    DAProcCacheStats stats;
+    DAProc* proc1;
+    DAProc* proc2;
+    pid_t pid[3];
+    int wfd[3];
+    guint i;
+
+    /* NULL resistance */
+    g_assert(!da_proc_cache_ref(NULL));
+    g_assert(!da_proc_cache_get(NULL, getpid()));
+    g_assert(!da_proc_cache_get(cache, 0));
+    da_proc_cache_unref(NULL);
+    da_proc_cache_set_ttl(NULL, 0);
+    da_proc_cache_remove(NULL, 0);
+    da_proc_cache_clear(NULL);
+    da_proc_cache_get_stats(NULL, &stats);
+    da_proc_cache_get_stats(cache, NULL);
+
+    /* Shared instance is shared */
+    g_assert(shared);
+    shared2 = da_proc_cache_shared();
+    g_assert(shared2 == shared);
+    da_proc_cache_unref(shared2);
+    da_proc_cache_unref(shared);
+
+    /* Second lookup is a hit */
+    proc1 = da_proc_cache_get(cache, getpid());
+    proc2 = da_proc_cache_get(cache, getpid());
+    g_assert(proc1);
+    g_assert(proc1 == proc2);
+    g_assert_cmpuint(proc1->cred.euid, == ,geteuid());
+    da_proc_unref(proc1);
+    da_proc_unref(proc2);
+    da_proc_cache_get_stats(cache, &stats);
+    g_assert_cmpuint(stats.hits, == ,1);
+    g_assert_cmpuint(stats.misses, == ,1);
+    g_assert_cmpuint(stats.size, == ,1);
+
+    /* Only two entries fit */
+    for (i = 0; i < G_N_ELEMENTS(pid); i++) {
+        pid[i] = test_proc_cache_child(wfd + i);
+        proc1 = da_proc_cache_get(cache, pid[i]);
+        g_assert(proc1);
+        g_assert_cmpuint(proc1->pid, == ,pid[i]);
+        da_proc_unref(proc1);
+    }
+    da_proc_cache_get_stats(cache, &stats);
+    g_assert_cmpuint(stats.misses, == ,4);
+    g_assert_cmpuint(stats.evictions, == ,2);
+    g_assert_cmpuint(stats.size, == ,2);
+
+    /* Dead process gets dropped */
+    test_proc_cache_reap(pid[2], wfd[2]);
+    g_assert(!da_proc_cache_get(cache, pid[2]));
+    da_proc_cache_get_stats(cache, &stats);
+    g_assert_cmpuint(stats.expirations, == ,1);
+    g_assert_cmpuint(stats.size, == ,1);
+
+    /* The other one is still there */
+    da_proc_unref(da_proc_cache_get(cache, pid[1]));
+    da_proc_cache_get_stats(cache, &stats);
+    g_assert_cmpuint(stats.hits, == ,2);
+
+    /* Explicit removal */
+    da_proc_cache_remove(cache, pid[1]);
+    da_proc_cache_get_stats(cache, &stats);
+    g_assert_cmpuint(stats.size, == ,0);
+
+    /* Zero TTL means that entries expire immediately */
+    da_proc_cache_set_ttl(cache, 0);
+    da_proc_unref(da_proc_cache_get(cache, getpid()));
+    da_proc_unref(da_proc_cache_get(cache, getpid()));
+    da_proc_cache_get_stats(cache, &stats);
+    g_assert_cmpuint(stats.hits, == ,2);
+    g_assert_cmpuint(stats.expirations, == ,2);
+    g_assert_cmpuint(stats.size, == ,1);
+    da_proc_cache_clear(cache);
+    da_proc_cache_get_stats(cache, &stats);
+    g_assert_cmpuint(stats.size, == ,0);
+
+    test_proc_cache_reap(pid[0], wfd[0]);
+    test_proc_cache_reap(pid[1], wfd[1]);
+    da_proc_cache_unref(da_proc_cache_ref(cache));
+    da_proc_cache_unref(cache);
+}
+
+/*==========================================================================*
+ * Snapshot
+ *==========================================================================*/
+
+static
+void
+test_proc_snapshot(
+    void)
+{
+    const pid_t pids[] = { getpid(), (pid_t)0xffffffff, 0, getpid() };
+    DAProc* procs[G_N_ELEMENTS(pids)];
+    DAProc** all;
+    guint i, n = 0;
+    gboolean found = FALSE;
+
+    g_assert(!da_proc_new_all(NULL, 0, DBUSACCESS_CRED_ALL, 0, NULL));
+    g_assert(!da_proc_new_all(pids, 0, DBUSACCESS_CRED_ALL, 0, procs));
+    da_proc_list_free(NULL, 0);
+
+    /* Single and multiple threads */
+    for (i = 1; i <= 2; i++) {
+        g_assert_cmpuint(da_proc_new_all(pids, G_N_ELEMENTS(pids),
+            DBUSACCESS_CRED_ALL, i, procs), == ,2);
+        g_assert(procs[0]);
+        g_assert(!procs[1]);
+        g_assert(!procs[2]);
+        g_assert(procs[3]);
+        g_assert_cmpuint(procs[0]->pid, == ,getpid());
+        g_assert_cmpuint(procs[3]->cred.euid, == ,geteuid());
+        da_proc_unref(procs[0]);
+        da_proc_unref(procs[3]);
+    }
+
+    /* This process must be there */
+    all = da_proc_snapshot(0, 0, &n);
+    g_assert(all);
+    g_assert(n > 0);
+    for (i = 0; i < n; i++) {
+        g_assert(all[i]);
+        g_assert_cmpuint(all[i]->cred.flags, == ,0);
+        if (all[i]->pid == getpid()) {
+            found = TRUE;
+        }
+    }
+    g_assert(found);
+    da_proc_list_free(all, n);
+}
+
 /*==========================================================================*
  * Self
  *==========================================================================*/
@@ -84,7 +466,82 @@ test_proc_self(
     self = da_self_new();
     g_assert(self);
     da_self_unref(da_self_ref(self));
+
+    /* Prepared credentials are attached to the object */
+    g_assert(!da_proc_prepared_cred(NULL));
+    g_assert(da_proc_prepared_cred(self));
+    g_assert(da_proc_prepared_cred(self) == da_proc_prepared_cred(self));
+    g_assert(da_proc_prepared_cred(self)->cred.euid == self->cred.euid);
+    da_self_unref(self);
+}
+
+/*==========================================================================*
+ * Intern
+ *==========================================================================*/
+
+static
+void
+test_proc_intern(
+    void)
+{
+    const pid_t pid = getpid();
+    DAProc* proc1 = da_proc_new(pid);
+    DAProc* proc2 = da_proc_new(pid);
+    DAProc* proc3 = da_proc_new_full(pid, 0);
+    DASelf* self = da_self_new();
+    const DACredPrepared* prepared;
+
+    g_assert(proc1);
+    g_assert(proc2);
+    g_assert(proc3);
+    g_assert(self);
+
+    /* Identical credentials share the same record */
+    prepared = da_proc_prepared_cred(proc1);
+    g_assert(prepared);
+    g_assert(prepared == da_proc_prepared_cred(proc2));
+    g_assert(prepared == da_proc_prepared_cred(self));
+    g_assert(prepared != da_proc_prepared_cred(proc3));
+
+    /* And the group list */
+    g_assert(proc1->cred.ngroups == prepared->cred.ngroups);
+    g_assert(proc1->cred.groups == prepared->cred.groups);
+    g_assert(proc2->cred.groups == proc1->cred.groups);
+    g_assert(!proc3->cred.groups);
+
+    da_proc_unref(proc1);
+    da_proc_unref(proc2);
+    da_proc_unref(proc3);
+    da_self_unref(self);
+}
+
+/*==========================================================================*
+ * SelfCred
+ *==========================================================================*/
+
+static
+void
+test_proc_self_cred(
+    void)
+{
+    /* Syscalls must give the same result as /proc/self/status */
+    DASelf* self = da_self_new();
+    DAProc* proc = da_proc_new(getpid());
+    guint i;
+
+    g_assert(self);
+    g_assert(proc);
+    g_assert_cmpuint(self->pid, == ,proc->pid);
+    g_assert_cmpuint(self->cred.euid, == ,proc->cred.euid);
+    g_assert_cmpuint(self->cred.egid, == ,proc->cred.egid);
+    g_assert_cmpuint(self->cred.flags, == ,proc->cred.flags);
+    g_assert_cmpuint(self->cred.caps, == ,proc->cred.caps);
+    g_assert_cmpuint(self->cred.ngroups, == ,proc->cred.ngroups);
+    for (i = 0; i < self->cred.ngroups; i++) {
+        g_assert_cmpuint(self->cred.groups[i], == ,proc->cred.groups[i]);
+    }
     da_self_unref(self);
+    da_proc_unref(proc);
 }
 
 /*==========================================================================*
@@ -96,13 +553,14 @@ void
 test_proc_self_shared(
     void)
 {
-    GMainLoop* loop = g_main_loop_new(NULL, TRUE);
-
-    /* Allocate two instances */
     DASelf* self1 = da_self_new_shared();
     DASelf* self2 = da_self_new_shared();
+    guint gen;
+
+    /* Two references to the same instance */
     g_assert(self1);
     g_assert(self1 == self2);
+    gen = da_self_shared_generation();
 
     /* Unref both */
     da_self_unref(self1);
@@ -111,34 +569,208 @@ test_proc_self_shared(
     /* Next call still returns the same pointer */
     self1 = da_self_new_shared();
     g_assert(self1 == self2);
-    da_self_unref(self1);
+    g_assert_cmpuint(da_self_shared_generation(), == ,gen);
 
-    /* Clear the shared instance */
+    /* Clear the shared instance, each flush bumps the generation */
     da_self_flush();
     da_self_flush();
+    g_assert_cmpuint(da_self_shared_generation(), == ,gen + 2);
 
-    /* Set shared instance timeout to the minimum */
-    setenv("DBUSACCESS_SELF_TIMEOUT_SEC", "0", TRUE);
-
-    /* This allocates a new shared instance */
-    self1 = da_self_new_shared();
-    g_assert(self1);
-    /* Disabled because with glib 2.78.4 the pointers are the same */
-    //g_assert(self1 != self2);
-
-    /* Let it expire */
-    g_timeout_add_seconds(0, test_loop_quit, loop);
-    g_main_loop_run(loop);
-
-    /* This allocates a new shared instance */
+    /* This allocates a new shared instance (self1 is still alive) */
     self2 = da_self_new_shared();
     g_assert(self2);
     g_assert(self1 != self2);
-
+    g_assert_cmpuint(da_self_shared_generation(), == ,gen + 3);
     da_self_unref(self1);
+
+    /* Changing credentials requires root */
+    if (!geteuid()) {
+        const int n = getgroups(0, NULL);
+        gid_t* saved = g_new(gid_t, MAX(n, 1));
+        const gid_t groups[] = { 12345 };
+
+        g_assert(getgroups(n, saved) == n);
+        g_assert(!setgroups(G_N_ELEMENTS(groups), groups));
+
+        /* The change gets noticed without any timer */
+        self1 = da_self_new_shared();
+        g_assert(self1 != self2);
+        g_assert_cmpuint(self1->cred.ngroups, == ,1);
+        g_assert_cmpuint(self1->cred.groups[0], == ,groups[0]);
+        g_assert_cmpuint(da_self_shared_generation(), == ,gen + 4);
+        da_self_unref(self1);
+
+        g_assert(!setgroups(n, saved));
+        g_free(saved);
+    }
+
     da_self_unref(self2);
     da_self_flush();
-    g_main_loop_unref(loop);
+}
+
+/*==========================================================================*
+ * SelfSharedThreads
+ *==========================================================================*/
+
+#define TEST_SELF_SHARED_THREADS (4)
+#define TEST_SELF_SHARED_LOOPS (10000)
+
+static
+gpointer
+test_proc_self_shared_thread(
+    gpointer data)
+{
+    guint i;
+
+    for (i = 0; i < TEST_SELF_SHARED_LOOPS; i++) {
+        DASelf* self = da_self_new_shared();
+
+        g_assert(self);
+        g_assert_cmpuint(self->pid, == ,getpid());
+        da_self_unref(self);
+    }
+    return NULL;
+}
+
+static
+void
+test_proc_self_shared_threads(
+    void)
+{
+    GThread* threads[TEST_SELF_SHARED_THREADS];
+    guint i;
+
+    /* Readers race with flushes */
+    for (i = 0; i < G_N_ELEMENTS(threads); i++) {
+        threads[i] = g_thread_new(NULL, test_proc_self_shared_thread, NULL);
+    }
+    for (i = 0; i < TEST_SELF_SHARED_LOOPS / 10; i++) {
+        da_self_flush();
+    }
+    for (i = 0; i < G_N_ELEMENTS(threads); i++) {
+        g_thread_join(threads[i]);
+    }
+    da_self_flush();
+}
+
+/*==========================================================================*
+ * Performance tests (only run with -m perf)
+ *==========================================================================*/
+
+static
+void
+test_proc_perf_new(
+    void)
+{
+    const pid_t pid = getpid();
+    const guint n = 20000;
+    double sec;
+    guint i;
+
+    g_test_timer_start();
+    for (i = 0; i < n; i++) {
+        da_proc_unref(da_proc_new(pid));
+    }
+    sec = g_test_timer_elapsed();
+    g_test_minimized_result(sec, "%u lookups in %.3f ms (%.1f us each)",
+        n, sec * 1000, sec * 1000000 / n);
+}
+
+static
+void
+test_proc_perf_self(
+    void)
+{
+    const guint n = 20000;
+    double sec;
+    guint i;
+
+    g_test_timer_start();
+    for (i = 0; i < n; i++) {
+        da_self_unref(da_self_new());
+    }
+    sec = g_test_timer_elapsed();
+    g_test_minimized_result(sec, "%u queries in %.3f ms (%.1f us each)",
+        n, sec * 1000, sec * 1000000 / n);
+}
+
+static
+void
+test_proc_perf_cache(
+    void)
+{
+    DAProcCache* cache = da_proc_cache_new(16, 60000, DBUSACCESS_CRED_ALL);
+    const pid_t pid = getpid();
+    const guint n = 20000;
+    double sec;
+    guint i;
+
+    g_test_timer_start();
+    for (i = 0; i < n; i++) {
+        da_proc_unref(da_proc_cache_get(cache, pid));
+    }
+    sec = g_test_timer_elapsed();
+    g_test_minimized_result(sec, "%u cached lookups in %.3f ms (%.1f us each)",
+        n, sec * 1000, sec * 1000000 / n);
+    da_proc_cache_unref(cache);
+}
+
+static
+void
+test_proc_perf_snapshot(
+    void)
+{
+    guint threads;
+
+    for (threads = 1; threads <= 4; threads *= 2) {
+        DAProc** all;
+        double sec;
+        guint n = 0;
+
+        g_test_timer_start();
+        all = da_proc_snapshot(DBUSACCESS_CRED_ALL, threads, &n);
+        sec = g_test_timer_elapsed();
+        g_test_minimized_result(sec, "%u thread(s): %u processes in %.3f ms",
+            threads, n, sec * 1000);
+        da_proc_list_free(all, n);
+    }
+}
+
+#define TEST_PERF_NEW_ALL_COUNT (3000)
+
+static
+void
+test_proc_perf_new_all(
+    void)
+{
+    /* A system with 3000 processes, live pids are repeated to get there */
+    pid_t* pids = g_new(pid_t, TEST_PERF_NEW_ALL_COUNT);
+    DAProc** procs = g_new(DAProc*, TEST_PERF_NEW_ALL_COUNT);
+    guint n = 0, i, threads;
+    DAProc** live = da_proc_snapshot(0, 0, &n);
+
+    g_assert(n > 0);
+    for (i = 0; i < TEST_PERF_NEW_ALL_COUNT; i++) {
+        pids[i] = live[i % n]->pid;
+    }
+    da_proc_list_free(live, n);
+
+    for (threads = 1; threads <= 4; threads *= 2) {
+        double sec;
+        guint created;
+
+        g_test_timer_start();
+        created = da_proc_new_all(pids, TEST_PERF_NEW_ALL_COUNT,
+            DBUSACCESS_CRED_ALL, threads, procs);
+        sec = g_test_timer_elapsed();
+        g_test_minimized_result(sec, "%u thread(s): %u of %u processes in "
+            "%.3f ms", threads, created, TEST_PERF_NEW_ALL_COUNT, sec * 1000);
+        for (i = 0; i < TEST_PERF_NEW_ALL_COUNT; i++) {
+            da_proc_unref(procs[i]);
+        }
+    }
+    g_free(procs);
+    g_free(pids);
 }
 
 /*==========================================================================*
@@ -151,8 +783,25 @@ int main(int argc, char* argv[])
 {
     g_test_init(&argc, &argv, NULL);
     g_test_add_func(TEST_("invalid"), test_proc_invalid);
+    g_test_add_func(TEST_("pid"), test_proc_pid);
+    g_test_add_func(TEST_("fields"), test_proc_fields);
+    g_test_add_func(TEST_("socket"), test_proc_socket);
+    g_test_add_func(TEST_("pidfd"), test_proc_pidfd);
+    g_test_add_func(TEST_("cache"), test_proc_cache);
+    g_test_add_func(TEST_("snapshot"), test_proc_snapshot);
     g_test_add_func(TEST_("self"), test_proc_self);
+    g_test_add_func(TEST_("self_cred"), test_proc_self_cred);
+    g_test_add_func(TEST_("intern"), test_proc_intern);
     g_test_add_func(TEST_("self_shared"), test_proc_self_shared);
+    g_test_add_func(TEST_("self_shared_threads"),
+        test_proc_self_shared_threads);
+    if (g_test_perf()) {
+        g_test_add_func(TEST_("perf/new"), test_proc_perf_new);
+        g_test_add_func(TEST_("perf/self"), test_proc_perf_self);
+        g_test_add_func(TEST_("perf/cache"), test_proc_perf_cache);
+        g_test_add_func(TEST_("perf/snapshot"), test_proc_perf_snapshot);
+        g_test_add_func(TEST_("perf/new_all"), test_proc_perf_new_all);
+    }
     test_init(&test_opt, argc, argv);
     return g_test_run();
 }
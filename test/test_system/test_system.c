@@ -0,0 +1,217 @@
+/*
+ * Copyright (C) 2026 Jolla Ltd.
+ *
+ * You may use this file under the terms of BSD license as follows:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *   3. Neither the names of the copyright holders nor the names of its
+ *      contributors may be used to endorse or promote products derived
+ *      from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "test_common.h"
+
+#include "dbusaccess_system_p.h"
+
+#include <glib/gstdio.h>
+
+static TestOpt test_opt;
+
+#define TEST_UNKNOWN_NAME "dbusaccess-no-such-name"
+
+/*==========================================================================*
+ * Null
+ *==========================================================================*/
+
+static
+void
+test_system_null(
+    void)
+{
+    g_assert(da_system_uid(NULL) == -1);
+    g_assert(da_system_gid(NULL) == -1);
+}
+
+/*==========================================================================*
+ * Basic
+ *==========================================================================*/
+
+static
+void
+test_system_basic(
+    void)
+{
+    /* Repeated lookups give the same result */
+    g_assert(da_system_uid("root") == 0);
+    g_assert(da_system_uid("root") == 0);
+    g_assert(da_system_gid("root") == 0);
+    g_assert(da_system_gid("root") == 0);
+
+    /* Unknown names are not cached but still fail */
+    g_assert(da_system_uid(TEST_UNKNOWN_NAME) == -1);
+    g_assert(da_system_uid(TEST_UNKNOWN_NAME) == -1);
+    g_assert(da_system_gid(TEST_UNKNOWN_NAME) == -1);
+    g_assert(da_system_gid(TEST_UNKNOWN_NAME) == -1);
+}
+
+/*==========================================================================*
+ * Cache
+ *==========================================================================*/
+
+#define TEST_KNOWN_NAME "known"
+#define TEST_KNOWN_ID (42)
+
+static int test_system_resolve_count = 0;
+
+static
+int
+test_system_resolve(
+    const char* name,
+    char* buf,
+    gsize size)
+{
+    test_system_resolve_count++;
+    return g_strcmp0(name, TEST_KNOWN_NAME) ? -1 : TEST_KNOWN_ID;
+}
+
+static
+void
+test_system_cache(
+    void)
+{
+    char* dir = g_dir_make_tmp("test_system_XXXXXX", NULL);
+    char* passwd = g_build_filename(dir, "passwd", NULL);
+    char* group = g_build_filename(dir, "group", NULL);
+
+    g_assert(g_file_set_contents(passwd, "a", -1, NULL));
+    g_assert(g_file_set_contents(group, "a", -1, NULL));
+    da_system_setup(passwd, group, test_system_resolve,
+        test_system_resolve, 0);
+
+    /* Second lookup comes from the cache */
+    test_system_resolve_count = 0;
+    g_assert_cmpint(da_system_uid(TEST_KNOWN_NAME), == ,TEST_KNOWN_ID);
+    g_assert_cmpint(da_system_uid(TEST_KNOWN_NAME), == ,TEST_KNOWN_ID);
+    g_assert_cmpint(test_system_resolve_count, == ,1);
+    g_assert_cmpint(da_system_gid(TEST_KNOWN_NAME), == ,TEST_KNOWN_ID);
+    g_assert_cmpint(da_system_gid(TEST_KNOWN_NAME), == ,TEST_KNOWN_ID);
+    g_assert_cmpint(test_system_resolve_count, == ,2);
+
+    /* Failed lookups are not cached */
+    g_assert_cmpint(da_system_uid(TEST_UNKNOWN_NAME), == ,-1);
+    g_assert_cmpint(da_system_uid(TEST_UNKNOWN_NAME), == ,-1);
+    g_assert_cmpint(test_system_resolve_count, == ,4);
+
+    /* Modifying the database flushes its cache (and only its cache) */
+    g_assert(g_file_set_contents(passwd, "ab", -1, NULL));
+    g_assert_cmpint(da_system_uid(TEST_KNOWN_NAME), == ,TEST_KNOWN_ID);
+    g_assert_cmpint(test_system_resolve_count, == ,5);
+    g_assert_cmpint(da_system_gid(TEST_KNOWN_NAME), == ,TEST_KNOWN_ID);
+    g_assert_cmpint(test_system_resolve_count, == ,5);
+
+    /* So does removing it */
+    g_unlink(group);
+    g_assert_cmpint(da_system_gid(TEST_KNOWN_NAME), == ,TEST_KNOWN_ID);
+    g_assert_cmpint(test_system_resolve_count, == ,6);
+    g_assert_cmpint(da_system_gid(TEST_KNOWN_NAME), == ,TEST_KNOWN_ID);
+    g_assert_cmpint(test_system_resolve_count, == ,6);
+
+    /* The files aren't checked more often than once per interval */
+    da_system_setup(passwd, group, test_system_resolve, test_system_resolve,
+        G_TIME_SPAN_HOUR);
+    test_system_resolve_count = 0;
+    g_assert_cmpint(da_system_uid(TEST_KNOWN_NAME), == ,TEST_KNOWN_ID);
+    g_assert(g_file_set_contents(passwd, "abc", -1, NULL));
+    g_assert_cmpint(da_system_uid(TEST_KNOWN_NAME), == ,TEST_KNOWN_ID);
+    g_assert_cmpint(test_system_resolve_count, == ,1);
+
+    da_system_setup(NULL, NULL, NULL, NULL, DA_SYSTEM_CHECK_INTERVAL);
+    g_unlink(passwd);
+    g_rmdir(dir);
+    g_free(passwd);
+    g_free(group);
+    g_free(dir);
+}
+
+/*==========================================================================*
+ * Threads
+ *==========================================================================*/
+
+#define TEST_THREADS (4)
+#define TEST_THREAD_LOOKUPS (1000)
+
+static
+gpointer
+test_system_thread(
+    gpointer data)
+{
+    int i;
+
+    for (i = 0; i < TEST_THREAD_LOOKUPS; i++) {
+        g_assert(da_system_uid("root") == 0);
+        g_assert(da_system_gid("root") == 0);
+        g_assert(da_system_gid(TEST_UNKNOWN_NAME) == -1);
+    }
+    return NULL;
+}
+
+static
+void
+test_system_threads(
+    void)
+{
+    GThread* threads[TEST_THREADS];
+    int i;
+
+    for (i = 0; i < TEST_THREADS; i++) {
+        threads[i] = g_thread_new("test", test_system_thread, NULL);
+    }
+    for (i = 0; i < TEST_THREADS; i++) {
+        g_thread_join(threads[i]);
+    }
+}
+
+/*==========================================================================*
+ * Common
+ *==========================================================================*/
+
+#define TEST_(t) "/system/" t
+
+int main(int argc, char* argv[])
+{
+    g_test_init(&argc, &argv, NULL);
+    g_test_add_func(TEST_("null"), test_system_null);
+    g_test_add_func(TEST_("basic"), test_system_basic);
+    g_test_add_func(TEST_("cache"), test_system_cache);
+    g_test_add_func(TEST_("threads"), test_system_threads);
+    test_init(&test_opt, argc, argv);
+    return g_test_run();
+}
+
+/*
+ * Local Variables:
+ * mode: C
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ */